@@ -0,0 +1,349 @@
+#ifndef AUGMENTED_AVLBST_H
+#define AUGMENTED_AVLBST_H
+
+#include <limits>
+#include "avlbst.h"
+
+/**
+* Monoids for AugmentedAVLTree. A monoid names the summary type, its
+* identity, how one entry becomes a summary (lift) and how two summaries
+* of adjacent key ranges combine, left range first.
+*/
+template <class Value>
+struct SumAggregate
+{
+    typedef Value type;
+    static Value identity() { return Value(); }
+    template<class Key>
+    static Value lift(const Key&, const Value& value) { return value; }
+    static Value combine(const Value& a, const Value& b) { return a + b; }
+};
+
+template <class Value>
+struct MinAggregate
+{
+    static_assert(std::numeric_limits<Value>::is_specialized,
+        "MinAggregate takes its identity from numeric_limits<Value>::max(); supply a monoid for other types");
+    typedef Value type;
+    static Value identity() { return std::numeric_limits<Value>::max(); }
+    template<class Key>
+    static Value lift(const Key&, const Value& value) { return value; }
+    static Value combine(const Value& a, const Value& b) { return b < a ? b : a; }
+};
+
+template <class Value>
+struct MaxAggregate
+{
+    static_assert(std::numeric_limits<Value>::is_specialized,
+        "MaxAggregate takes its identity from numeric_limits<Value>::lowest(); supply a monoid for other types");
+    typedef Value type;
+    static Value identity() { return std::numeric_limits<Value>::lowest(); }
+    template<class Key>
+    static Value lift(const Key&, const Value& value) { return value; }
+    static Value combine(const Value& a, const Value& b) { return a < b ? b : a; }
+};
+
+/**
+* An AVLNode that also stores the summary of its whole subtree.
+*/
+template <class Key, class Value, class Summary>
+class AugmentedAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AugmentedAVLNode(const Key& key, const Value& value, AVLNode<Key, Value>* parent) :
+        AVLNode<Key, Value>(key, value, parent), summary_() { }
+
+    const Summary& getSummary() const { return summary_; }
+    void setSummary(const Summary& summary) { summary_ = summary; }
+
+protected:
+    Summary summary_;
+};
+
+/**
+* An AVLTree whose nodes carry Monoid's summary of their subtree, kept up
+* to date by insert, remove and every rotation (through AVLTree::rotated()),
+* so that aggregate(lo, hi) folds a key range in O(log n) instead of
+* walking it.
+*
+* Iterators are read-only, since a value written through one would leave
+* the summaries above it stale; values change through insert() or
+* assign(). Bulk operations that build nodes themselves (build, merge,
+* relayout, ...) are not offered.
+*/
+template <class Key, class Value, class Monoid = SumAggregate<Value> >
+class AugmentedAVLTree : protected AVLTree<Key, Value>
+{
+    typedef AVLTree<Key, Value> Base;
+
+public:
+    typedef typename Monoid::type Summary;
+    typedef AugmentedAVLNode<Key, Value, Summary> AugNode;
+
+    /**
+    * Visits the entries in key order, key and value both read-only.
+    */
+    class iterator
+    {
+    public:
+        iterator() : node_(NULL) { }
+
+        const typename Node<Key, Value>::Item& operator*() const { return node_->getItem(); }
+        const typename Node<Key, Value>::Item* operator->() const { return &node_->getItem(); }
+        bool operator==(const iterator& rhs) const { return node_ == rhs.node_; }
+        bool operator!=(const iterator& rhs) const { return node_ != rhs.node_; }
+        iterator& operator++() { node_ = node_->getNext(); return *this; }
+
+    protected:
+        friend class AugmentedAVLTree<Key, Value, Monoid>;
+        explicit iterator(Node<Key, Value>* node) : node_(node) { }
+        Node<Key, Value>* node_;
+    };
+
+    AugmentedAVLTree();
+    AugmentedAVLTree(const AugmentedAVLTree<Key, Value, Monoid>& other);
+    AugmentedAVLTree(AugmentedAVLTree<Key, Value, Monoid>&& other) noexcept;
+    AugmentedAVLTree<Key, Value, Monoid>& operator=(const AugmentedAVLTree<Key, Value, Monoid>& other);
+    AugmentedAVLTree<Key, Value, Monoid>& operator=(AugmentedAVLTree<Key, Value, Monoid>&& other) noexcept;
+
+    virtual void insert(const std::pair<const Key, Value>& item);
+    void assign(iterator pos, const Value& value);
+    Summary aggregate(const Key& lo, const Key& hi) const;
+
+    iterator find(const Key& key) const { return iterator(this->internalFind(key)); }
+    iterator begin() const { return iterator(this->getSmallestNode()); }
+    iterator end() const { return iterator(); }
+    iterator erase(iterator pos);
+
+    using Base::remove;
+    using Base::clear;
+    using Base::empty;
+    using Base::isBalanced;
+    using Base::print;
+
+protected:
+    static iterator iteratorAt(Node<Key, Value>* node) { return iterator(node); }
+    virtual void detachNode(Node<Key, Value>* node);
+    virtual void rotated(AVLNode<Key, Value>* down, AVLNode<Key, Value>* up);
+    static Summary summary(AVLNode<Key, Value>* node);
+    static void pull(AVLNode<Key, Value>* node);
+    static void pullPath(AVLNode<Key, Value>* node);
+};
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::AugmentedAVLTree()
+{
+}
+
+/**
+* Copies other node for node, summaries included, in O(n).
+*/
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::AugmentedAVLTree(const AugmentedAVLTree<Key, Value, Monoid>& other) : Base()
+{
+  this->template cloneFrom<AugNode>(other);
+}
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>::AugmentedAVLTree(AugmentedAVLTree<Key, Value, Monoid>&& other) noexcept :
+  Base(std::move(other))
+{
+}
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>& AugmentedAVLTree<Key, Value, Monoid>::operator=(
+    const AugmentedAVLTree<Key, Value, Monoid>& other)
+{
+  if (this != &other) {
+    this->clear();
+    this->template cloneFrom<AugNode>(other);
+  }
+  return *this;
+}
+
+template<class Key, class Value, class Monoid>
+AugmentedAVLTree<Key, Value, Monoid>& AugmentedAVLTree<Key, Value, Monoid>::operator=(
+    AugmentedAVLTree<Key, Value, Monoid>&& other) noexcept
+{
+  Base::operator=(std::move(other));
+  return *this;
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Summary
+AugmentedAVLTree<Key, Value, Monoid>::summary(AVLNode<Key, Value>* node)
+{
+  return node == nullptr ? Monoid::identity() : static_cast<AugNode*>(node)->getSummary();
+}
+
+/**
+* Recomputes node's summary from its children's, which must be current.
+*/
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pull(AVLNode<Key, Value>* node)
+{
+  Summary mid = Monoid::lift(node->getKey(), node->getValue());
+  static_cast<AugNode*>(node)->setSummary(
+    Monoid::combine(Monoid::combine(summary(node->getLeft()), mid), summary(node->getRight())));
+}
+
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pullPath(AVLNode<Key, Value>* node)
+{
+  for (; node != nullptr; node = node->getParent()) {
+    pull(node);
+  }
+}
+
+/**
+* A rotation keeps the set of keys below the top position, so only the
+* two rotated nodes need new summaries, the lower one first.
+*/
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::rotated(AVLNode<Key, Value>* down, AVLNode<Key, Value>* up)
+{
+  pull(down);
+  pull(up);
+}
+
+/**
+* As AVLTree::insert, but the summaries on the path are brought up to date
+* before rebalancing, after which rotated() keeps them that way.
+*/
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::insert(const std::pair<const Key, Value>& item)
+{
+  AVLNode<Key, Value>* parent = nullptr;
+  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->root_);
+  while (node != nullptr) {
+    if (item.first < node->getKey()) {
+      parent = node;
+      node = node->getLeft();
+    }
+    else if (node->getKey() < item.first) {
+      parent = node;
+      node = node->getRight();
+    }
+    else {
+      node->setValue(item.second);
+      pullPath(node);
+      return;
+    }
+  }
+
+  node = new AugNode(item.first, item.second, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+  }
+  else if (item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  pullPath(node);
+  if (parent != nullptr) {
+    this->insertFix(parent, node);
+  }
+}
+
+/**
+* Replaces the value pos refers to and brings the summaries from there to
+* the root up to date. O(log n).
+*/
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::assign(iterator pos, const Value& value)
+{
+  pos.node_->setValue(value);
+  pullPath(static_cast<AVLNode<Key, Value>*>(pos.node_));
+}
+
+/**
+* Removes the entry pos refers to and returns an iterator to the next one.
+*/
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::iterator AugmentedAVLTree<Key, Value, Monoid>::erase(iterator pos)
+{
+  Node<Key, Value>* next = pos.node_->getNext();
+  this->eraseNode(pos.node_);
+  return iterator(next);
+}
+
+/**
+* As AVLTree::detachNode, with the summaries from the changed spot up
+* refreshed before rebalancing.
+*/
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::detachNode(Node<Key, Value>* victim)
+{
+  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(victim);
+  this->unlinkInOrder(node);
+
+  AVLNode<Key, Value>* heir = nullptr;
+  if (node->getLeft() && node->getRight()) {
+    heir = static_cast<AVLNode<Key, Value>*>(this->predecessor(node));
+  }
+  bool leftShrank;
+  AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(this->spliceOut(node, leftShrank));
+  if (heir) {
+    heir->setBalance(node->getBalance());
+  }
+  pullPath(parent);
+  this->removeFix(parent, leftShrank);
+}
+
+/**
+* Monoid's fold over the entries with keys in [lo, hi), in key order.
+* Descends to the first node inside the range, then down each boundary:
+* every node inside the range there contributes itself plus its whole
+* subtree on the inner side. O(log n).
+*/
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Summary
+AugmentedAVLTree<Key, Value, Monoid>::aggregate(const Key& lo, const Key& hi) const
+{
+  AVLNode<Key, Value>* split = static_cast<AVLNode<Key, Value>*>(this->root_);
+  while (split != nullptr) {
+    if (split->getKey() < lo) {
+      split = split->getRight();
+    }
+    else if (!(split->getKey() < hi)) {
+      split = split->getLeft();
+    }
+    else {
+      break;
+    }
+  }
+  if (split == nullptr) {
+    return Monoid::identity();
+  }
+
+  Summary left = Monoid::identity();
+  for (AVLNode<Key, Value>* node = split->getLeft(); node != nullptr; ) {
+    if (node->getKey() < lo) {
+      node = node->getRight();
+    }
+    else {
+      Summary mine = Monoid::combine(Monoid::lift(node->getKey(), node->getValue()), summary(node->getRight()));
+      left = Monoid::combine(mine, left);
+      node = node->getLeft();
+    }
+  }
+
+  Summary right = Monoid::identity();
+  for (AVLNode<Key, Value>* node = split->getRight(); node != nullptr; ) {
+    if (node->getKey() < hi) {
+      Summary mine = Monoid::combine(summary(node->getLeft()), Monoid::lift(node->getKey(), node->getValue()));
+      right = Monoid::combine(right, mine);
+      node = node->getRight();
+    }
+    else {
+      node = node->getLeft();
+    }
+  }
+
+  return Monoid::combine(Monoid::combine(left, Monoid::lift(split->getKey(), split->getValue())), right);
+}
+
+#endif
@@ -6,6 +6,13 @@
 #include <cstdlib>
 #include <cstdint>
 #include <algorithm>
+#include <vector>
+#include <thread>
+#include <stdexcept>
+#include <atomic>
+#include <memory>
+#include <functional>
+#include <new>
 #include "bst.h"
 
 struct KeyError { };
@@ -127,58 +134,235 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
+/**
+* Node orders relayout() can place the tree in.
+*/
+enum LayoutOrder {
+    LAYOUT_VEB,   // van Emde Boas: every subtree of height 2^k is contiguous, good at any cache size
+    LAYOUT_BFS    // level order: the hot top levels share cache lines and pages
+};
+
+/**
+* One contiguous allocation holding the nodes placed by relayout(). It is
+* freed once none of its nodes is live any more; since split() and
+* extractRange() can spread its nodes over several trees, trees share it
+* through shared_ptr and live_ is atomic for the parallel merge.
+*/
+template <class Key, class Value>
+struct AVLLayoutBlock
+{
+    explicit AVLLayoutBlock(size_t count) :
+        nodes_(static_cast<AVLNode<Key, Value>*>(::operator new(count * sizeof(AVLNode<Key, Value>)))),
+        count_(count), live_(0) { }
+    ~AVLLayoutBlock() { ::operator delete(nodes_); }
+
+    bool contains(const Node<Key, Value>* node) const
+    {
+        std::less<const Node<Key, Value>*> less;
+        return !less(node, nodes_) && less(node, nodes_ + count_);
+    }
+
+    AVLNode<Key, Value>* nodes_;
+    size_t count_;
+    std::atomic<size_t> live_;
+
+private:
+    AVLLayoutBlock(const AVLLayoutBlock&);
+    AVLLayoutBlock& operator=(const AVLLayoutBlock&);
+};
+
 template <class Key, class Value>
 class AVLTree : public BinarySearchTree<Key, Value>
 {
 public:
+    AVLTree();
+    AVLTree(const AVLTree<Key, Value>& other);
+    AVLTree(AVLTree<Key, Value>&& other) noexcept;
+    AVLTree<Key, Value>& operator=(const AVLTree<Key, Value>& other);
+    AVLTree<Key, Value>& operator=(AVLTree<Key, Value>&& other) noexcept;
+    virtual ~AVLTree();
+    void swap(AVLTree<Key, Value>& other) noexcept;
+    typedef NodeHandle<Key, Value, AVLTree<Key, Value> > node_type;
+    node_type extract(const Key& key);
+    node_type extract(typename BinarySearchTree<Key, Value>::iterator pos);
+    typename BinarySearchTree<Key, Value>::iterator insert(node_type&& handle);
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
-    virtual void remove(const Key& key);  // TODO
+    virtual void clear();
+    void relayout(LayoutOrder order = LAYOUT_VEB);
+
+    void build(std::vector<std::pair<Key, Value> > items, unsigned int threads = 0);
+    void merge(AVLTree<Key, Value>&& other, unsigned int threads = 0);
+
+    void join(AVLTree<Key, Value>& left, const std::pair<const Key, Value>& item, AVLTree<Key, Value>& right);
+    void split(const Key& key, AVLTree<Key, Value>& left, AVLTree<Key, Value>& right);
+    void eraseRange(const Key& lo, const Key& hi);
+    void extractRange(const Key& lo, const Key& hi, AVLTree<Key, Value>& out);
 protected:
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
+    virtual void eraseNode(Node<Key, Value>* node);
+    virtual void detachNode(Node<Key, Value>* node);
+    virtual typename BinarySearchTree<Key, Value>::NodeDispose releaseNode(Node<Key, Value>* node, std::shared_ptr<void>& storage);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+        typename BinarySearchTree<Key, Value>::NodeDispose dispose);
+    static void disposeBlockNode(Node<Key, Value>* node, void* block);
+    virtual void eraseNodes(const std::vector<Node<Key, Value>*>& doomed, size_t total);
+    AVLNode<Key, Value>* relinkSubtree(const std::vector<AVLNode<Key, Value>*>& nodes, size_t lo, size_t hi);
 
     AVLNode<Key, Value>* rotateLeft(AVLNode<Key, Value>* x);
     AVLNode<Key, Value>* rotateRight(AVLNode<Key, Value>* y);
+    virtual void rotated(AVLNode<Key, Value>* down, AVLNode<Key, Value>* up); // per-subtree data hook
 
 
-    void updateBalanceAndFix(AVLNode<Key, Value>* node);
-    AVLNode<Key, Value>* insertHelper(AVLNode<Key, Value>* node, const std::pair<const Key, Value>& new_item);
+    bool insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* child);
+    void removeFix(AVLNode<Key, Value>* parent, bool leftShrank);
     int height(AVLNode<Key, Value>* node) const;
-    void updateBalance(AVLNode<Key, Value>* node);
     AVLNode<Key, Value>* balanceTree(AVLNode<Key, Value>* node);
 
+    // Join-based helpers. These work on detached subtrees (parent == NULL)
+    // and never touch root_, so disjoint subtrees can be processed in parallel.
+    // Heights are passed in and out (-1 for an empty subtree) so that no
+    // helper has to walk a subtree to find one.
+    AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right);
+    AVLNode<Key, Value>* joinNodes(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* mid,
+        AVLNode<Key, Value>* right, int hr, int& h);
+    void splitNodes(AVLNode<Key, Value>* node, int h, const Key& key,
+        AVLNode<Key, Value>*& left, int& hl, AVLNode<Key, Value>*& found, AVLNode<Key, Value>*& right, int& hr);
+    static void neighbours(AVLNode<Key, Value>* node, const Key& key,
+        AVLNode<Key, Value>*& before, AVLNode<Key, Value>*& after);
+    static void endChain(AVLNode<Key, Value>* node);
+    static void linkAround(AVLNode<Key, Value>* left, AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right);
+    AVLNode<Key, Value>* concatNodes(AVLNode<Key, Value>* left, AVLNode<Key, Value>* right);
+    AVLNode<Key, Value>* removeMinNode(AVLNode<Key, Value>* node, AVLNode<Key, Value>*& min);
+    void splitRange(const Key& lo, const Key& hi, AVLNode<Key, Value>*& outside, AVLNode<Key, Value>*& inside);
+    /**
+    * A detached subtree for unionNodes(): its root, height, and smallest
+    * and largest nodes, so that joins can thread the successor chain
+    * without walking a spine. last may be NULL for a piece of the second
+    * tree whose largest node still links to its successor there.
+    */
+    struct Span
+    {
+        AVLNode<Key, Value>* root;
+        int height;
+        AVLNode<Key, Value>* first;
+        AVLNode<Key, Value>* last;
+    };
+    Span unionNodes(Span t1, Span t2, int spawnDepth);
+    Span spanOf(AVLNode<Key, Value>* root) const;
+    AVLNode<Key, Value>* buildSubtree(const std::vector<std::pair<Key, Value> >& items,
+        size_t lo, size_t hi, int spawnDepth);
+    static int spawnDepthFor(unsigned int threads);
+
+    // Layout blocks (relayout()). Nodes outside every block came from new.
+    virtual void destroyNode(Node<Key, Value>* node);
+    void adoptBlocks(AVLTree<Key, Value>& from);
+    void shareBlocks(const AVLTree<Key, Value>& from);
+    void releaseEmptyBlocks();
+    static void vebOrder(AVLNode<Key, Value>* node, int levels, std::vector<AVLNode<Key, Value>*>& out);
+    static void collectAtDepth(AVLNode<Key, Value>* node, int depth, std::vector<AVLNode<Key, Value>*>& out);
+
+    std::vector<std::shared_ptr<AVLLayoutBlock<Key, Value> > > blocks_;
+};
 
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree()
+{
+}
 
+/**
+* Copies other node for node, balances included, in O(n) without a single
+* rotation. The copies are ordinary heap nodes; call relayout() to pack
+* them if other had been laid out.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(const AVLTree<Key, Value>& other) : BinarySearchTree<Key, Value>()
+{
+  this->template cloneFrom<AVLNode<Key, Value> >(other);
+}
 
-};
+/**
+* Takes other's nodes and layout blocks in O(1), leaving it empty.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::AVLTree(AVLTree<Key, Value>&& other) noexcept :
+  BinarySearchTree<Key, Value>(std::move(other)), blocks_(std::move(other.blocks_))
+{
+}
 
 template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x) {
-  AVLNode<Key, Value>* y = x->getRight();
-  x->setRight(y->getLeft());
+AVLTree<Key, Value>& AVLTree<Key, Value>::operator=(const AVLTree<Key, Value>& other)
+{
+  if (this != &other) {
+    clear();
+    this->template cloneFrom<AVLNode<Key, Value> >(other);
+  }
+  return *this;
+}
 
-  if (y->getLeft() != nullptr) {
-    y->getLeft()->setParent(x);
+template<class Key, class Value>
+AVLTree<Key, Value>& AVLTree<Key, Value>::operator=(AVLTree<Key, Value>&& other) noexcept
+{
+  if (this != &other) {
+    clear();
+    this->root_ = other.root_;
+    other.root_ = nullptr;
+    blocks_ = std::move(other.blocks_);
+    other.blocks_.clear();
   }
+  return *this;
+}
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::swap(AVLTree<Key, Value>& other) noexcept
+{
+  BinarySearchTree<Key, Value>::swap(other);
+  blocks_.swap(other.blocks_);
+}
+
+/**
+* The base destructor can no longer reach destroyNode(), so nodes that live
+* in a layout block have to be released here.
+*/
+template<class Key, class Value>
+AVLTree<Key, Value>::~AVLTree()
+{
+  clear();
+}
 
-  y->setParent(x->getParent());
+template<class Key, class Value>
+void AVLTree<Key, Value>::clear()
+{
+  BinarySearchTree<Key, Value>::clear();
+  blocks_.clear();
+}
 
-  if (x->getParent() == nullptr) {
-    this->root_ = y;
-  } 
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* x) {
+  AVLNode<Key, Value>* y = x->getRight();
+  BinarySearchTree<Key, Value>::rotateLeft(x);
 
-  else if (x == x->getParent()->getLeft()) {
-    x->getParent()->setLeft(y);
-  } 
+  // balance = height(right) - height(left); only x and y changed shape
+  int8_t xb = x->getBalance();
+  int8_t yb = y->getBalance();
+  x->setBalance(xb - 1 - std::max<int8_t>(yb, 0));
+  y->setBalance(yb - 1 + std::min<int8_t>(x->getBalance(), 0));
+  rotated(x, y);
 
-  else {
-    x->getParent()->setRight(y);
-  }
-  y->setLeft(x);
-  x->setParent(y);
-  
   return y; // New root of the subtree
 }
 
+/**
+* Called after every rotation with the node that moved down and the one
+* that took its place, in that order, so that a subclass keeping data
+* about whole subtrees can recompute both from their new children.
+* AVLTree keeps none.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::rotated(AVLNode<Key, Value>* down, AVLNode<Key, Value>* up) {
+  (void)down;
+  (void)up;
+}
+
 template<class Key, class Value>
 AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* y) {
   if (!y) {
@@ -191,29 +375,13 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* y) {
     return y; // cannot rotate without a left child
   }
 
-  // Perform rotation
-  y->setLeft(x->getRight());
+  BinarySearchTree<Key, Value>::rotateRight(y);
 
-  if (x->getRight() != nullptr) {
-    x->getRight()->setParent(y);
-  }
-  
-  x->setParent(y->getParent());
-  
-  if (y->getParent() == nullptr) {
-    this->root_ = x;
-  } 
-  
-  else if (y == y->getParent()->getLeft()) {
-    y->getParent()->setLeft(x);
-  } 
-  
-  else {
-    y->getParent()->setRight(x);
-  }
-  
-  x->setRight(y);
-  y->setParent(x);
+  int8_t xb = x->getBalance();
+  int8_t yb = y->getBalance();
+  y->setBalance(yb + 1 - std::min<int8_t>(xb, 0));
+  x->setBalance(xb + 1 + std::max<int8_t>(y->getBalance(), 0));
+  rotated(y, x);
 
   return x; // Return the new root of the subtree
 }
@@ -226,61 +394,90 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* y) {
 template<class Key, class Value>
 void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
 {
-  this->root_ = insertHelper(static_cast<AVLNode<Key, Value>*>(this->root_), new_item);
-}
-
-template<class Key, class Value>
-AVLNode<Key, Value>* AVLTree<Key, Value>::insertHelper(AVLNode<Key, Value>* node, const std::pair<const Key, Value>& new_item) {
-  if (node == nullptr) {
-    // new node if we've found the insert location
-    return new AVLNode<Key, Value>(new_item.first, new_item.second, nullptr);
+  AVLNode<Key, Value>* parent = nullptr;
+  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->root_);
+  while (node != nullptr) {
+    if (new_item.first < node->getKey()) {
+      parent = node;
+      node = node->getLeft();
+    }
+    else if (new_item.first > node->getKey()) {
+      parent = node;
+      node = node->getRight();
+    }
+    else {
+      // already exists, update value
+      node->setValue(new_item.second);
+      return;
+    }
   }
 
-  if (new_item.first < node->getKey()) {
-    node->setLeft(insertHelper(static_cast<AVLNode<Key, Value>*>(node->getLeft()), new_item));
-    node->getLeft()->setParent(node);
-  } 
-
-  else if (new_item.first > node->getKey()) {
-    node->setRight(insertHelper(static_cast<AVLNode<Key, Value>*>(node->getRight()), new_item));
-    node->getRight()->setParent(node);
-  } 
-
+  node = new AVLNode<Key, Value>(new_item.first, new_item.second, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+    return;
+  }
+  if (new_item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
   else {
-    // already exists, update value
-    node->setValue(new_item.second);
-    return node;
+    parent->setRight(node);
   }
-
-  // update the balance factor of the node
-  updateBalance(node);
-  return balanceTree(node);
+  this->linkInOrder(node);
+  insertFix(parent, node);
 }
 
-template<class Key, class Value> // asdjk
-void AVLTree<Key, Value>::updateBalance(AVLNode<Key, Value>* node) { 
-  if (node == nullptr) {
-    return;
+/**
+* Walks up from a subtree (child) whose height just grew by one, updating
+* balances and rotating at the first node that goes out of balance.
+* Returns whether the growth reached the top, i.e. the whole tree is now
+* one taller.
+*/
+template<class Key, class Value>
+bool AVLTree<Key, Value>::insertFix(AVLNode<Key, Value>* parent, AVLNode<Key, Value>* child) {
+  while (parent != nullptr) {
+    parent->updateBalance(child == parent->getLeft() ? -1 : 1);
+    if (parent->getBalance() == 0) {
+      return false; // height of parent unchanged
+    }
+    if (parent->getBalance() == 1 || parent->getBalance() == -1) {
+      child = parent;
+      parent = parent->getParent();
+      continue;
+    }
+
+    // A child with balance 0 can only come from a join; rotating over it
+    // leaves the subtree one taller, so the walk has to continue.
+    bool childLevel = child->getBalance() == 0;
+    child = balanceTree(parent);
+    if (!childLevel) {
+      return false;
+    }
+    parent = child->getParent();
   }
-  node->setBalance(height(node->getRight()) - height(node->getLeft()));
+  return true;
 }
 
+/**
+* Rotates a node whose balance is +2/-2 back into shape and returns the new
+* root of its subtree.
+*/
 template<class Key, class Value>
 AVLNode<Key, Value>* AVLTree<Key, Value>::balanceTree(AVLNode<Key, Value>* node) {
-  // left heavy
+  // right heavy
   if (node->getBalance() > 1) {
-    if (node->getRight() != nullptr && node->getRight()->getBalance() < 0) {
+    if (node->getRight()->getBalance() < 0) {
       // RL 
-      node->setRight(rotateRight(static_cast<AVLNode<Key, Value>*>(node->getRight())));
+      rotateRight(node->getRight());
     }
     // RR 
     return rotateLeft(node);
   }
-  //right heavy
+  // left heavy
   else if (node->getBalance() < -1) {
-    if (node->getLeft() != nullptr && node->getLeft()->getBalance() > 0) {
+    if (node->getLeft()->getBalance() > 0) {
       // LR 
-      node->setLeft(rotateLeft(static_cast<AVLNode<Key, Value>*>(node->getLeft())));
+      rotateLeft(node->getLeft());
     }
     // LL 
     return rotateRight(node);
@@ -290,109 +487,1022 @@ AVLNode<Key, Value>* AVLTree<Key, Value>::balanceTree(AVLNode<Key, Value>* node)
 }
 
 
+/**
+* Removes node (found by remove() or held by an iterator) and frees it.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseNode(Node<Key, Value>* node) {
+  BinarySearchTree<Key, Value>::eraseNode(node);
+  releaseEmptyBlocks();
+}
+
+/**
+* Unhooks node and rebalances; node itself stays alive.
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::remove(const Key& key) {
-  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
-  if (!node) {
-    return; //  not found
-  }
+void AVLTree<Key, Value>::detachNode(Node<Key, Value>* victim) {
+  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(victim);
+  this->unlinkInOrder(node);
 
-  // node with two children
+  // a predecessor moved into node's place takes over its balance as well
+  AVLNode<Key, Value>* heir = nullptr;
   if (node->getLeft() && node->getRight()) {
-    AVLNode<Key, Value>* predecessor = static_cast<AVLNode<Key, Value>*>(this->predecessor(node));
-    nodeSwap(node, predecessor);
-    // points to where 'predecessor' was and has at most one child
+    heir = static_cast<AVLNode<Key, Value>*>(this->predecessor(node));
+  }
+  bool leftShrank;
+  AVLNode<Key, Value>* parent = static_cast<AVLNode<Key, Value>*>(this->spliceOut(node, leftShrank));
+  if (heir) {
+    heir->setBalance(node->getBalance());
   }
+  removeFix(parent, leftShrank); // rebalance from where the tree lost a level
+}
 
-  AVLNode<Key, Value>* child;
-  if (node->getLeft()) {
-    child = node->getLeft();
-  } 
-  else {
-    child = node->getRight();
+/**
+* A node placed by relayout() cannot be deleted; its handle keeps the
+* layout block alive and gives the slot back to it when discarded.
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::NodeDispose
+AVLTree<Key, Value>::releaseNode(Node<Key, Value>* node, std::shared_ptr<void>& storage) {
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    if (blocks_[i]->contains(node)) {
+      storage = blocks_[i];
+      return &AVLTree<Key, Value>::disposeBlockNode;
+    }
   }
+  return BinarySearchTree<Key, Value>::releaseNode(node, storage);
+}
 
+template<class Key, class Value>
+void AVLTree<Key, Value>::disposeBlockNode(Node<Key, Value>* node, void* block) {
+  static_cast<AVLNode<Key, Value>*>(node)->~AVLNode();
+  static_cast<AVLLayoutBlock<Key, Value>*>(block)->live_.fetch_sub(1, std::memory_order_relaxed);
+}
 
-  if (child) {
-    child->setParent(node->getParent()); // link child to parent of the node to be removed
+/**
+* As BinarySearchTree's, but with handles only a AVLTree takes back.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::node_type AVLTree<Key, Value>::extract(const Key& key) {
+  return this->template extractKey<node_type>(key);
+}
+
+template<class Key, class Value>
+typename AVLTree<Key, Value>::node_type AVLTree<Key, Value>::extract(typename BinarySearchTree<Key, Value>::iterator pos) {
+  return this->template extractAt<node_type>(pos);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator AVLTree<Key, Value>::insert(node_type&& handle) {
+  return this->insertHandle(std::move(handle));
+}
+
+/**
+* Links a node from another AVLTree as a fresh leaf and rebalances. If it
+* lives in a layout block, this tree shares that block from now on.
+*/
+template<class Key, class Value>
+Node<Key, Value>* AVLTree<Key, Value>::attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+    typename BinarySearchTree<Key, Value>::NodeDispose dispose) {
+  Node<Key, Value>* at = this->placeLeaf(node);
+  if (at != node) {
+    return at;
+  }
+  if (dispose == &AVLTree<Key, Value>::disposeBlockNode) {
+    // only releaseNode() pairs that disposal with storage, and always a layout block
+    std::shared_ptr<AVLLayoutBlock<Key, Value> > block = std::static_pointer_cast<AVLLayoutBlock<Key, Value> >(storage);
+    if (std::find(blocks_.begin(), blocks_.end(), block) == blocks_.end()) {
+      blocks_.push_back(block);
+    }
   }
-  
-  if (node->getParent()) {
-    if (node == node->getParent()->getLeft()) {
-      node->getParent()->setLeft(child);
-    } 
+  AVLNode<Key, Value>* leaf = static_cast<AVLNode<Key, Value>*>(node);
+  leaf->setBalance(0);
+  if (leaf->getParent() != nullptr) {
+    insertFix(leaf->getParent(), leaf);
+  }
+  return node;
+}
 
+/**
+* eraseIf() victims. k single removes cost about k log n; relinking the n
+* survivors into a perfectly balanced shape costs n and allocates nothing,
+* so a large sweep takes the second route.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseNodes(const std::vector<Node<Key, Value>*>& doomed, size_t total) {
+  size_t depth = 1;
+  while ((size_t(1) << depth) < total) {
+    ++depth;
+  }
+  if (doomed.size() * depth < total) {
+    for (size_t i = 0; i < doomed.size(); ++i) {
+      eraseNode(doomed[i]);
+    }
+    return;
+  }
+
+  std::vector<AVLNode<Key, Value>*> survivors;
+  survivors.reserve(total - doomed.size());
+  size_t d = 0;
+  Node<Key, Value>* node = this->getSmallestNode();
+  while (node != nullptr) {
+    Node<Key, Value>* next = node->getNext();
+    if (d < doomed.size() && node == doomed[d]) {
+      ++d;
+      destroyNode(node);
+    }
     else {
-      node->getParent()->setRight(child);
+      survivors.push_back(static_cast<AVLNode<Key, Value>*>(node));
+    }
+    node = next;
+  }
+  for (size_t i = 0; i < survivors.size(); ++i) {
+    survivors[i]->setNext(i + 1 < survivors.size() ? survivors[i + 1] : nullptr);
+  }
+  this->root_ = relinkSubtree(survivors, 0, survivors.size());
+  if (this->root_ != nullptr) {
+    this->root_->setParent(nullptr);
+  }
+  releaseEmptyBlocks();
+}
+
+/**
+* Like buildSubtree(), but reuses the sorted nodes [lo, hi) as they are;
+* only their tree links and balances are rewritten.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::relinkSubtree(const std::vector<AVLNode<Key, Value>*>& nodes,
+    size_t lo, size_t hi)
+{
+  if (lo >= hi) {
+    return nullptr;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  AVLNode<Key, Value>* node = nodes[mid];
+  AVLNode<Key, Value>* left = relinkSubtree(nodes, lo, mid);
+  AVLNode<Key, Value>* right = relinkSubtree(nodes, mid + 1, hi);
+  node->setLeft(left);
+  node->setRight(right);
+  if (left) left->setParent(node);
+  if (right) right->setParent(node);
+  node->setBalance(height(right) - height(left));
+  return node;
+}
+
+/**
+* Walks up from parent after one of its subtrees lost one level of height,
+* rotating where needed. Stops as soon as a subtree's height is unchanged.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::removeFix(AVLNode<Key, Value>* parent, bool leftShrank) {
+  while (parent) {
+    parent->updateBalance(leftShrank ? 1 : -1);
+    int8_t balance = parent->getBalance();
+
+    if (balance == 1 || balance == -1) {
+      return; // height of parent unchanged
+    }
+
+    AVLNode<Key, Value>* top = parent;
+    if (balance != 0) {
+      AVLNode<Key, Value>* sibling = balance > 0 ? parent->getRight() : parent->getLeft();
+      bool siblingLevel = sibling->getBalance() == 0;
+      top = balanceTree(parent);
+      if (siblingLevel) {
+        return; // single rotation over a level sibling keeps the height
+      }
+    }
+
+    parent = top->getParent();  // Move up the tree
+    if (parent) {
+      leftShrank = (top == parent->getLeft());
+    }
+  }
+}
+
+
+/**
+* Height of a subtree (-1 when empty), found in O(log n) by following the
+* taller side as recorded in the balance factors.
+*/
+template <class Key, class Value>
+int AVLTree<Key, Value>::height(AVLNode<Key, Value>* node) const {
+  int h = -1;
+  while (node != nullptr) {
+    ++h;
+    node = node->getBalance() < 0 ? node->getLeft() : node->getRight();
+  }
+  return h;
+}
+
+
+template<class Key, class Value>
+void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    int8_t tempB = n1->getBalance();
+    n1->setBalance(n2->getBalance());
+    n2->setBalance(tempB);
+}
+
+/**
+* Threads mid into the successor chain between the largest node of left
+* and the smallest node of right. Nodes in the middle of either subtree
+* keep their links; only the seam is rewritten.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::linkAround(AVLNode<Key, Value>* left, AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right)
+{
+  if (left != nullptr) {
+    while (left->getRight() != nullptr) {
+      left = left->getRight();
     }
-    updateBalanceAndFix(node->getParent()); // rebalance from the parent of the removed node
+    left->setNext(mid);
+  }
+  while (right != nullptr && right->getLeft() != nullptr) {
+    right = right->getLeft();
+  }
+  mid->setNext(right);
+}
 
-  } 
+/**
+* Clears the successor link of the largest node of a subtree that has just
+* become a tree of its own.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::endChain(AVLNode<Key, Value>* node)
+{
+  if (node == nullptr) {
+    return;
+  }
+  while (node->getRight() != nullptr) {
+    node = node->getRight();
+  }
+  node->setNext(nullptr);
+}
 
+/**
+* Joins two detached subtrees around mid, where every key in left is smaller
+* than mid's key and every key in right is larger, and threads mid into the
+* successor chain between them. Finding the heights and the seam walks both
+* subtrees, so this costs O(log n); the helpers below that already know
+* them use the other overload.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::joinNodes(
+    AVLNode<Key, Value>* left, AVLNode<Key, Value>* mid, AVLNode<Key, Value>* right)
+{
+  linkAround(left, mid, right);
+  int h;
+  return joinNodes(left, height(left), mid, right, height(right), h);
+}
+
+/**
+* Joins as above, given the heights hl and hr of left and right, and sets
+* h to that of the result. Leaves the successor chain alone. Runs in
+* O(|hl - hr| + 1) and returns the new detached root.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::joinNodes(AVLNode<Key, Value>* left, int hl, AVLNode<Key, Value>* mid,
+    AVLNode<Key, Value>* right, int hr, int& h)
+{
+  mid->setParent(nullptr);
+
+  if (hl <= hr + 1 && hr <= hl + 1) {
+    mid->setLeft(left);
+    mid->setRight(right);
+    if (left) left->setParent(mid);
+    if (right) right->setParent(mid);
+    mid->setBalance(hr - hl);
+    h = std::max(hl, hr) + 1;
+    return mid;
+  }
+
+  // Walk down the inner spine of the taller tree to a node whose height is
+  // within one of the shorter tree, and hang mid there.
+  bool leftTaller = hl > hr;
+  AVLNode<Key, Value>* top = leftTaller ? left : right;
+  AVLNode<Key, Value>* shorter = leftTaller ? right : left;
+  int hs = leftTaller ? hr : hl;
+  AVLNode<Key, Value>* parent = nullptr;
+  AVLNode<Key, Value>* curr = top;
+  int hc = leftTaller ? hl : hr;
+  h = hc;
+  while (hc > hs + 1) {
+    parent = curr;
+    if (leftTaller) {
+      hc -= (curr->getBalance() >= 0) ? 1 : 2;
+      curr = curr->getRight();
+    }
+    else {
+      hc -= (curr->getBalance() <= 0) ? 1 : 2;
+      curr = curr->getLeft();
+    }
+  }
+
+  if (leftTaller) {
+    mid->setLeft(curr);
+    mid->setRight(shorter);
+    parent->setRight(mid);
+    mid->setBalance(hs - hc);
+  }
   else {
-    this->root_ = child; // child becomes the new root
+    mid->setLeft(shorter);
+    mid->setRight(curr);
+    parent->setLeft(mid);
+    mid->setBalance(hc - hs);
   }
+  if (curr) curr->setParent(mid);
+  if (shorter) shorter->setParent(mid);
+  mid->setParent(parent);
 
-  delete node; // free the memory of the node to be removed
+  // mid is exactly one taller than the subtree it replaced
+  if (insertFix(parent, mid)) {
+    ++h;
+  }
+  // at most one rotation can have put a node above the old top
+  while (top->getParent() != nullptr) {
+    top = top->getParent();
+  }
+  return top;
 }
 
+/**
+* Splits a detached subtree of height h into the keys smaller than key
+* (left, of height hl), the node holding key if there is one (found,
+* detached) and the keys larger than key (right, of height hr). Each level
+* costs one join of pieces whose heights differ by about as much as the
+* levels they came from, so the whole split is O(h). Pieces are
+* contiguous runs of the subtree's keys, so their successor links stay
+* right except at the two ends: the largest node of left (and found)
+* still points into what follows.
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::updateBalanceAndFix(AVLNode<Key, Value>* node) {
-  while (node) {
-    int balance = height(node->getLeft()) - height(node->getRight());
-    node->setBalance(balance);
+void AVLTree<Key, Value>::splitNodes(AVLNode<Key, Value>* node, int h, const Key& key,
+    AVLNode<Key, Value>*& left, int& hl, AVLNode<Key, Value>*& found, AVLNode<Key, Value>*& right, int& hr)
+{
+  if (node == nullptr) {
+    left = found = right = nullptr;
+    hl = hr = -1;
+    return;
+  }
 
-    if (balance > 1) {
-      if (height(node->getLeft()->getRight()) > height(node->getLeft()->getLeft())) {
-          rotateLeft(node->getLeft());
+  AVLNode<Key, Value>* l = node->getLeft();
+  AVLNode<Key, Value>* r = node->getRight();
+  int lh = h - 1 - (node->getBalance() > 0 ? 1 : 0);
+  int rh = h - 1 - (node->getBalance() < 0 ? 1 : 0);
+  if (l) l->setParent(nullptr);
+  if (r) r->setParent(nullptr);
+  node->setLeft(nullptr);
+  node->setRight(nullptr);
+  node->setParent(nullptr);
+  node->setBalance(0);
+
+  if (key == node->getKey()) {
+    left = l;
+    hl = lh;
+    found = node;
+    right = r;
+    hr = rh;
+  }
+  else if (key < node->getKey()) {
+    AVLNode<Key, Value>* rest;
+    int hrest;
+    splitNodes(l, lh, key, left, hl, found, rest, hrest);
+    right = joinNodes(rest, hrest, node, r, rh, hr);
+  }
+  else {
+    AVLNode<Key, Value>* rest;
+    int hrest;
+    splitNodes(r, rh, key, rest, hrest, found, right, hr);
+    left = joinNodes(l, lh, node, rest, hrest, hl);
+  }
+}
+
+/**
+* Finds the largest node below key (before) and the smallest above it
+* (after) in a detached subtree, NULL where there is none. O(height).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::neighbours(AVLNode<Key, Value>* node, const Key& key,
+    AVLNode<Key, Value>*& before, AVLNode<Key, Value>*& after)
+{
+  before = after = nullptr;
+  while (node != nullptr) {
+    if (node->getKey() < key) {
+      before = node;
+      node = node->getRight();
+    }
+    else if (key < node->getKey()) {
+      after = node;
+      node = node->getLeft();
+    }
+    else {
+      for (AVLNode<Key, Value>* l = node->getLeft(); l != nullptr; l = l->getRight()) {
+        before = l;
       }
-      rotateRight(node);
-    } 
-    
-    else if (balance < -1) {
-      if (height(node->getRight()->getLeft()) > height(node->getRight()->getRight())) {
-          rotateRight(node->getRight());
+      for (AVLNode<Key, Value>* r = node->getRight(); r != nullptr; r = r->getLeft()) {
+        after = r;
       }
-      rotateLeft(node);
+      return;
     }
+  }
+}
 
-    node = node->getParent();  // Move up the tree
+/**
+* Number of recursion levels that should fork a new thread so that roughly
+* `threads` workers are busy.
+*/
+template<class Key, class Value>
+int AVLTree<Key, Value>::spawnDepthFor(unsigned int threads)
+{
+  if (threads == 0) {
+    threads = std::thread::hardware_concurrency();
+  }
+  int depth = 0;
+  while ((1u << depth) < threads) {
+    ++depth;
   }
+  return depth;
 }
 
+/**
+* Union of two detached subtrees. Where both hold a key, the node from t2
+* wins. Splits t1 around t2's root and recurses on both halves. Splits and
+* joins cost O(height) and O(height difference) since every piece carries
+* its height, and the successor chain is threaded at each join through
+* the pieces' first and last nodes rather than by walking to them, which
+* gives O(m log(n/m + 1)) work for sizes m <= n.
+*
+* The result's chain is right throughout except for the last node's link.
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::Span AVLTree<Key, Value>::unionNodes(Span t1, Span t2, int spawnDepth)
+{
+  if (t1.root == nullptr) {
+    return t2;
+  }
+  if (t2.root == nullptr) {
+    return t1;
+  }
 
-template <class Key, class Value>
-int AVLTree<Key, Value>::height(AVLNode<Key, Value>* node) const {
-  if (node == nullptr) {
-      // Height of an empty tree is -1
-      return -1;
-  } 
+  AVLNode<Key, Value>* mid = t2.root;
+  int balance = mid->getBalance();
+  // l2's largest node is mid's predecessor and already links to mid
+  Span l2 = { mid->getLeft(), t2.height - 1 - (balance > 0 ? 1 : 0), t2.first, nullptr };
+  Span r2 = { mid->getRight(), t2.height - 1 - (balance < 0 ? 1 : 0),
+      static_cast<AVLNode<Key, Value>*>(mid->getNext()), t2.last };
+  if (l2.root) l2.root->setParent(nullptr);
+  if (r2.root) r2.root->setParent(nullptr);
+
+  AVLNode<Key, Value>* before;
+  AVLNode<Key, Value>* after;
+  neighbours(t1.root, mid->getKey(), before, after);
+  Span l1 = { nullptr, -1, t1.first, before };
+  Span r1 = { nullptr, -1, after, t1.last };
+  AVLNode<Key, Value>* dup;
+  splitNodes(t1.root, t1.height, mid->getKey(), l1.root, l1.height, dup, r1.root, r1.height);
+  destroyNode(dup);
+
+  Span l;
+  Span r;
+  if (spawnDepth > 0) {
+    std::thread worker([&]() { l = unionNodes(l1, l2, spawnDepth - 1); });
+    r = unionNodes(r1, r2, spawnDepth - 1);
+    worker.join();
+  }
+  else {
+    l = unionNodes(l1, l2, 0);
+    r = unionNodes(r1, r2, 0);
+  }
 
+  if (l.root != nullptr && l.last != nullptr) {
+    l.last->setNext(mid);
+  }
+  if (r.root != nullptr) {
+    mid->setNext(r.first);
+  }
+  Span joined;
+  joined.root = joinNodes(l.root, l.height, mid, r.root, r.height, joined.height);
+  joined.first = l.root != nullptr ? l.first : mid;
+  joined.last = r.root != nullptr ? r.last : mid;
+  return joined;
+}
+
+/**
+* The Span of a whole detached subtree. O(log n).
+*/
+template<class Key, class Value>
+typename AVLTree<Key, Value>::Span AVLTree<Key, Value>::spanOf(AVLNode<Key, Value>* root) const
+{
+  Span span = { root, height(root), root, root };
+  while (span.first != nullptr && span.first->getLeft() != nullptr) {
+    span.first = span.first->getLeft();
+  }
+  while (span.last != nullptr && span.last->getRight() != nullptr) {
+    span.last = span.last->getRight();
+  }
+  return span;
+}
+
+/**
+* Moves every entry of other into this tree, leaving other empty. Entries
+* from other overwrite entries with the same key, as insert() would, but
+* no node is reallocated or copied.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::merge(AVLTree<Key, Value>&& other, unsigned int threads)
+{
+  if (&other == this) {
+    return;
+  }
+  AVLNode<Key, Value>* mine = static_cast<AVLNode<Key, Value>*>(this->root_);
+  AVLNode<Key, Value>* theirs = static_cast<AVLNode<Key, Value>*>(other.root_);
+  this->root_ = nullptr;
+  other.root_ = nullptr;
+  adoptBlocks(other);
+  Span merged = unionNodes(spanOf(mine), spanOf(theirs), spawnDepthFor(threads));
+  if (merged.last != nullptr) {
+    merged.last->setNext(nullptr);
+  }
+  this->root_ = merged.root;
+  releaseEmptyBlocks();
+}
+
+/**
+* Builds a perfectly balanced subtree from the sorted, duplicate free
+* range [lo, hi) of items, forking the left half onto its own thread while
+* spawnDepth > 0.
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::buildSubtree(const std::vector<std::pair<Key, Value> >& items,
+    size_t lo, size_t hi, int spawnDepth)
+{
+  if (lo >= hi) {
+    return nullptr;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  AVLNode<Key, Value>* node = new AVLNode<Key, Value>(items[mid].first, items[mid].second, nullptr);
+
+  AVLNode<Key, Value>* left;
+  AVLNode<Key, Value>* right;
+  if (spawnDepth > 0) {
+    std::thread worker([&]() { left = buildSubtree(items, lo, mid, spawnDepth - 1); });
+    right = buildSubtree(items, mid + 1, hi, spawnDepth - 1);
+    worker.join();
+  }
   else {
-    // find the height of the left and right subtrees and add 1 for the current node
-    int leftHeight = height(node->getLeft());
-    int rightHeight = height(node->getRight());
-    int max_height = 0;
-    // Return the greater of the two heights plus one
-    if (leftHeight > rightHeight) {
-      max_height = leftHeight;
-    } 
+    left = buildSubtree(items, lo, mid, 0);
+    right = buildSubtree(items, mid + 1, hi, 0);
+  }
+
+  node->setLeft(left);
+  node->setRight(right);
+  if (left) left->setParent(node);
+  if (right) right->setParent(node);
+  linkAround(left, node, right);
+  // sizes differ by at most one, so do the heights
+  node->setBalance(height(right) - height(left));
+  return node;
+}
+
+/**
+* Replaces the contents of the tree with items. The items are sorted in
+* parallel (chunks sorted on their own threads, then merged pairwise) and
+* the tree is built bottom-up in O(n) without any rotations. When a key
+* appears more than once the last occurrence wins, as with repeated insert().
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::build(std::vector<std::pair<Key, Value> > items, unsigned int threads)
+{
+  this->clear();
+  if (threads == 0) {
+    threads = std::max(1u, std::thread::hardware_concurrency());
+  }
+
+  struct KeyLess {
+    bool operator()(const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) const {
+      return a.first < b.first;
+    }
+  };
+
+  // stable so that later duplicates stay after earlier ones
+  size_t chunks = std::min<size_t>(threads, std::max<size_t>(1, items.size() / 4096));
+  std::vector<size_t> bounds;
+  for (size_t i = 0; i <= chunks; ++i) {
+    bounds.push_back(items.size() * i / chunks);
+  }
+  std::vector<std::thread> workers;
+  for (size_t i = 1; i < chunks; ++i) {
+    workers.push_back(std::thread([&items, &bounds, i]() {
+      std::stable_sort(items.begin() + bounds[i], items.begin() + bounds[i + 1], KeyLess());
+    }));
+  }
+  std::stable_sort(items.begin(), items.begin() + bounds[1], KeyLess());
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  for (size_t width = 1; width < chunks; width *= 2) {
+    workers.clear();
+    for (size_t i = 0; i + width < chunks; i += 2 * width) {
+      size_t first = bounds[i];
+      size_t middle = bounds[i + width];
+      size_t last = bounds[std::min(i + 2 * width, chunks)];
+      workers.push_back(std::thread([&items, first, middle, last]() {
+        std::inplace_merge(items.begin() + first, items.begin() + middle, items.begin() + last, KeyLess());
+      }));
+    }
+    for (size_t i = 0; i < workers.size(); ++i) {
+      workers[i].join();
+    }
+  }
+
+  // keep the last value of each run of equal keys
+  size_t count = 0;
+  for (size_t i = 0; i < items.size(); ++i) {
+    if (count > 0 && items[count - 1].first == items[i].first) {
+      items[count - 1].second = items[i].second;
+    }
     else {
-      max_height = rightHeight;
+      if (count != i) {
+        items[count] = items[i];
+      }
+      ++count;
     }
-    return max_height + 1;
   }
+  items.resize(count);
+
+  this->root_ = buildSubtree(items, 0, items.size(), spawnDepthFor(threads));
 }
 
+/**
+* Detaches the smallest node of a detached subtree, returning it through
+* min, and returns the root of what is left. O(log n).
+*/
+template<class Key, class Value>
+AVLNode<Key, Value>* AVLTree<Key, Value>::removeMinNode(AVLNode<Key, Value>* node, AVLNode<Key, Value>*& min)
+{
+  while (node->getLeft() != nullptr) {
+    node = node->getLeft();
+  }
+  min = node;
 
+  AVLNode<Key, Value>* parent = node->getParent();
+  AVLNode<Key, Value>* child = node->getRight();
+  node->setParent(nullptr);
+  node->setRight(nullptr);
+  node->setBalance(0);
+  if (child) {
+    child->setParent(parent);
+  }
+  if (parent == nullptr) {
+    return child;
+  }
+
+  parent->setLeft(child);
+  removeFix(parent, true);
+  while (parent->getParent() != nullptr) {
+    parent = parent->getParent();
+  }
+  return parent;
+}
+
+/**
+* Joins two detached subtrees where every key in left is smaller than every
+* key in right, borrowing the smallest node of right as the middle. O(log n).
+*/
 template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+AVLNode<Key, Value>* AVLTree<Key, Value>::concatNodes(AVLNode<Key, Value>* left, AVLNode<Key, Value>* right)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
-    int8_t tempB = n1->getBalance();
-    n1->setBalance(n2->getBalance());
-    n2->setBalance(tempB);
+  if (left == nullptr) {
+    return right;
+  }
+  if (right == nullptr) {
+    return left;
+  }
+  AVLNode<Key, Value>* mid;
+  right = removeMinNode(right, mid);
+  return joinNodes(left, mid, right);
+}
+
+/**
+* Replaces the contents of this tree with left, item and right, leaving
+* left and right empty. Every key in left must be smaller than item's key
+* and every key in right larger; otherwise std::invalid_argument is thrown
+* and nothing is changed. Runs in O(log n) with a single new node.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::join(AVLTree<Key, Value>& left, const std::pair<const Key, Value>& item, AVLTree<Key, Value>& right)
+{
+  Node<Key, Value>* lmax = left.root_;
+  while (lmax && lmax->getRight()) {
+    lmax = lmax->getRight();
+  }
+  Node<Key, Value>* rmin = right.getSmallestNode();
+  if ((lmax && !(lmax->getKey() < item.first)) || (rmin && !(item.first < rmin->getKey()))) {
+    throw std::invalid_argument("AVLTree::join: keys out of order");
+  }
+
+  // everything that can throw happens before either side is touched
+  blocks_.reserve(blocks_.size() + left.blocks_.size() + right.blocks_.size());
+  AVLNode<Key, Value>* mid = new AVLNode<Key, Value>(item.first, item.second, nullptr);
+
+  AVLNode<Key, Value>* l = static_cast<AVLNode<Key, Value>*>(left.root_);
+  AVLNode<Key, Value>* r = static_cast<AVLNode<Key, Value>*>(right.root_);
+  left.root_ = nullptr;
+  right.root_ = nullptr;
+  if (this != &left && this != &right) {
+    this->clear();
+  }
+  adoptBlocks(left);
+  adoptBlocks(right);
+  this->root_ = joinNodes(l, mid, r);
+}
+
+/**
+* Moves every entry with a key smaller than key into left and every other
+* entry into right, leaving this tree empty. Whatever left and right held
+* before is discarded. O(log n); no node is reallocated.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::split(const Key& key, AVLTree<Key, Value>& left, AVLTree<Key, Value>& right)
+{
+  AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+  this->root_ = nullptr;
+  if (&left != this) left.clear();
+  if (&right != this) right.clear();
+
+  AVLNode<Key, Value>* l;
+  AVLNode<Key, Value>* found;
+  AVLNode<Key, Value>* r;
+  int hl;
+  int hr;
+  splitNodes(root, height(root), key, l, hl, found, r, hr);
+  if (found) {
+    r = joinNodes(nullptr, -1, found, r, hr, hr); // found already links to r's first node
+  }
+  endChain(l);
+  std::vector<std::shared_ptr<AVLLayoutBlock<Key, Value> > > blocks;
+  blocks.swap(blocks_);
+  left.root_ = l;
+  right.root_ = r;
+  left.blocks_.insert(left.blocks_.end(), blocks.begin(), blocks.end());
+  right.blocks_.insert(right.blocks_.end(), blocks.begin(), blocks.end());
+}
+
+/**
+* Cuts the entries with keys in [lo, hi) out of the tree. The rest of the
+* tree is left in outside, the cut entries in inside, both as detached
+* AVL subtrees.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::splitRange(const Key& lo, const Key& hi,
+    AVLNode<Key, Value>*& outside, AVLNode<Key, Value>*& inside)
+{
+  AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+  this->root_ = nullptr;
+
+  AVLNode<Key, Value>* below;
+  AVLNode<Key, Value>* found;
+  AVLNode<Key, Value>* rest;
+  int hBelow;
+  int hRest;
+  splitNodes(root, height(root), lo, below, hBelow, found, rest, hRest);
+  if (found) {
+    rest = joinNodes(nullptr, -1, found, rest, hRest, hRest); // found already links to rest's first node
+  }
+
+  AVLNode<Key, Value>* above;
+  int hInside;
+  int hAbove;
+  splitNodes(rest, hRest, hi, inside, hInside, found, above, hAbove);
+  if (found) {
+    above = joinNodes(nullptr, -1, found, above, hAbove, hAbove);
+  }
+  outside = concatNodes(below, above);
+  endChain(outside);
+}
+
+/**
+* Removes every entry with a key in [lo, hi) in O(log n + k) for k removed
+* entries: two splits, one delete per removed node and a single join,
+* instead of k separate removes that each rebalance a full path.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::eraseRange(const Key& lo, const Key& hi)
+{
+  if (!(lo < hi)) {
+    return;
+  }
+  AVLNode<Key, Value>* outside;
+  AVLNode<Key, Value>* inside;
+  splitRange(lo, hi, outside, inside);
+  this->eraseFunc(inside);
+  this->root_ = outside;
+  releaseEmptyBlocks();
+}
+
+/**
+* Like eraseRange() but moves the entries with keys in [lo, hi) into out
+* (replacing its contents) instead of deleting them. O(log n) plus the
+* cost of clearing out.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::extractRange(const Key& lo, const Key& hi, AVLTree<Key, Value>& out)
+{
+  if (&out == this) {
+    return;
+  }
+  out.clear();
+  if (!(lo < hi)) {
+    return;
+  }
+  AVLNode<Key, Value>* outside;
+  AVLNode<Key, Value>* inside;
+  splitRange(lo, hi, outside, inside);
+  endChain(inside);
+  this->root_ = outside;
+  out.root_ = inside;
+  out.shareBlocks(*this);
+  releaseEmptyBlocks();
+}
+
+/**
+* Nodes placed by relayout() were constructed inside a block and are only
+* destructed here; the block itself goes in releaseEmptyBlocks(). May run
+* concurrently from the parallel merge, so blocks_ is only read.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
+  for (size_t i = 0; i < blocks_.size(); ++i) {
+    if (blocks_[i]->contains(node)) {
+      static_cast<AVLNode<Key, Value>*>(node)->~AVLNode();
+      blocks_[i]->live_.fetch_sub(1, std::memory_order_relaxed);
+      return;
+    }
+  }
+  delete node;
+}
+
+/**
+* Takes over the blocks of a tree whose nodes have just been moved into
+* this one, leaving it with none.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::adoptBlocks(AVLTree<Key, Value>& from)
+{
+  if (&from == this) {
+    return;
+  }
+  shareBlocks(from);
+  from.blocks_.clear();
+}
+
+/**
+* Starts sharing from's blocks, for when some of its nodes move into this
+* tree and some stay behind.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::shareBlocks(const AVLTree<Key, Value>& from)
+{
+  for (size_t i = 0; i < from.blocks_.size(); ++i) {
+    if (std::find(blocks_.begin(), blocks_.end(), from.blocks_[i]) == blocks_.end()) {
+      blocks_.push_back(from.blocks_[i]);
+    }
+  }
+}
+
+/**
+* Drops blocks with no live node left (all of them once the tree is empty),
+* which frees each block when no other tree shares it.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::releaseEmptyBlocks()
+{
+  if (this->root_ == nullptr) {
+    blocks_.clear();
+    return;
+  }
+  for (size_t i = 0; i < blocks_.size(); ) {
+    if (blocks_[i]->live_.load(std::memory_order_relaxed) == 0) {
+      blocks_[i] = blocks_.back();
+      blocks_.pop_back();
+    }
+    else {
+      ++i;
+    }
+  }
+}
+
+/**
+* Appends the nodes levels deep below node (node itself at depth 0).
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::collectAtDepth(AVLNode<Key, Value>* node, int depth, std::vector<AVLNode<Key, Value>*>& out)
+{
+  if (node == nullptr) {
+    return;
+  }
+  if (depth == 0) {
+    out.push_back(node);
+    return;
+  }
+  collectAtDepth(node->getLeft(), depth - 1, out);
+  collectAtDepth(node->getRight(), depth - 1, out);
+}
+
+/**
+* Appends the top `levels` levels of the subtree at node in van Emde Boas
+* order: the upper half of the levels recursively, then each subtree
+* hanging below it recursively.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::vebOrder(AVLNode<Key, Value>* node, int levels, std::vector<AVLNode<Key, Value>*>& out)
+{
+  if (node == nullptr) {
+    return;
+  }
+  if (levels == 1) {
+    out.push_back(node);
+    return;
+  }
+  int top = levels / 2;
+  vebOrder(node, top, out);
+  std::vector<AVLNode<Key, Value>*> below;
+  collectAtDepth(node, top, below);
+  for (size_t i = 0; i < below.size(); ++i) {
+    vebOrder(below[i], levels - top, out);
+  }
+}
+
+/**
+* Moves every node into one freshly allocated block, placed in the given
+* order, so that a search walks through nearby memory instead of wherever
+* the allocator happened to put each node. The tree stays fully mutable:
+* later inserts allocate as usual and removed block nodes are just
+* destructed; the block is freed when its last node goes. Iterators and
+* node pointers are invalidated. O(n) time, O(n) temporary space.
+*/
+template<class Key, class Value>
+void AVLTree<Key, Value>::relayout(LayoutOrder order)
+{
+  AVLNode<Key, Value>* root = static_cast<AVLNode<Key, Value>*>(this->root_);
+  if (root == nullptr) {
+    return;
+  }
+
+  std::vector<AVLNode<Key, Value>*> old;
+  if (order == LAYOUT_BFS) {
+    old.push_back(root);
+    for (size_t i = 0; i < old.size(); ++i) {
+      if (old[i]->getLeft()) old.push_back(old[i]->getLeft());
+      if (old[i]->getRight()) old.push_back(old[i]->getRight());
+    }
+  }
+  else {
+    vebOrder(root, height(root) + 1, old);
+  }
+
+  // copy the entries first, so a throwing copy leaves the tree untouched
+  std::shared_ptr<AVLLayoutBlock<Key, Value> > block(new AVLLayoutBlock<Key, Value>(old.size()));
+  AVLNode<Key, Value>* fresh = block->nodes_;
+  size_t built = 0;
+  try {
+    for (; built < old.size(); ++built) {
+      new (fresh + built) AVLNode<Key, Value>(old[built]->getKey(), old[built]->getValue(), nullptr);
+    }
+  }
+  catch (...) {
+    while (built > 0) {
+      fresh[--built].~AVLNode();
+    }
+    throw;
+  }
+  block->live_.store(old.size());
+
+  // borrow each old node's successor link to remember where it moved to
+  for (size_t i = 0; i < old.size(); ++i) {
+    fresh[i].setNext(old[i]->getNext());
+    old[i]->setNext(fresh + i);
+  }
+  for (size_t i = 0; i < old.size(); ++i) {
+    AVLNode<Key, Value>* o = old[i];
+    AVLNode<Key, Value>* n = fresh + i;
+    n->setBalance(o->getBalance());
+    if (o->getParent()) n->setParent(static_cast<AVLNode<Key, Value>*>(o->getParent()->getNext()));
+    if (o->getLeft()) n->setLeft(static_cast<AVLNode<Key, Value>*>(o->getLeft()->getNext()));
+    if (o->getRight()) n->setRight(static_cast<AVLNode<Key, Value>*>(o->getRight()->getNext()));
+    if (n->getNext()) n->setNext(n->getNext()->getNext());
+  }
+
+  this->root_ = root->getNext();
+  for (size_t i = 0; i < old.size(); ++i) {
+    destroyNode(old[i]);
+  }
+  releaseEmptyBlocks();
+  blocks_.push_back(block);
 }
 
 
-#endif
\ No newline at end of file
+#endif
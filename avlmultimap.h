@@ -0,0 +1,491 @@
+#ifndef AVLMULTIMAP_H
+#define AVLMULTIMAP_H
+
+#include <cstddef>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* The values AVLMultiMap keeps under one key. It is a vector that can also
+* be streamed, so the underlying tree can still be printed with print().
+*/
+template <class Value>
+struct MultiMapChunk : public std::vector<Value>
+{
+    MultiMapChunk() { }
+    MultiMapChunk(size_t count, const Value& value) : std::vector<Value>(count, value) { }
+};
+
+template <class Value>
+std::ostream& operator<<(std::ostream& out, const MultiMapChunk<Value>& chunk)
+{
+    return out << chunk.size() << (chunk.size() == 1 ? " value" : " values");
+}
+
+/**
+* An ordered multimap on top of AVLTree. Each distinct key gets a single
+* node holding all of its values in a MultiMapChunk, in insertion order, so
+* adding a value under a key that is already present is an amortized O(1)
+* append after the O(log n) lookup, and the tree only grows with the
+* number of distinct keys.
+*
+* Iteration visits every (key, value) pair in key order, values of the
+* same key in insertion order. An iterator is a node and an index into its
+* chunk: it stays valid until its key goes away, but erasing a value
+* shifts the later values of the same key down one, so iterators to those
+* then refer to the value after theirs (or one past the key's last value).
+* References from *it or value() last until a value is added or erased
+* under the same key.
+*/
+template <class Key, class Value>
+class AVLMultiMap : protected AVLTree<Key, MultiMapChunk<Value> >
+{
+    typedef AVLTree<Key, MultiMapChunk<Value> > Base;
+    typedef Node<Key, MultiMapChunk<Value> > ChunkNode;
+    typedef AVLNode<Key, MultiMapChunk<Value> > ChunkAVLNode;
+
+public:
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key&, Value&> operator*() const;
+
+        // lets it->first / it->second work although there is no stored pair
+        struct Arrow
+        {
+            std::pair<const Key&, Value&> item;
+            const std::pair<const Key&, Value&>* operator->() const { return &item; }
+        };
+        Arrow operator->() const;
+
+        const Key& key() const;
+        Value& value() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+        iterator& operator++();
+
+    protected:
+        friend class AVLMultiMap<Key, Value>;
+        iterator(ChunkNode* node, size_t index);
+        ChunkNode* node_;
+        size_t index_;
+    };
+
+    AVLMultiMap();
+
+    void insert(const std::pair<const Key, Value>& item);
+    size_t erase(const Key& key);
+    iterator erase(iterator pos);
+    void clear();
+
+    size_t count(const Key& key) const;
+    size_t size() const;
+    bool empty() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    std::pair<iterator, iterator> equalRange(const Key& key) const;
+    const std::vector<Value>* values(const Key& key) const;
+
+    using Base::isBalanced;
+    using Base::relayout;
+
+private:
+    size_t size_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for AVLMultiMap::iterator.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+AVLMultiMap<Key, Value>::iterator::iterator() : node_(NULL), index_(0)
+{
+}
+
+template<class Key, class Value>
+AVLMultiMap<Key, Value>::iterator::iterator(ChunkNode* node, size_t index) : node_(node), index_(index)
+{
+}
+
+template<class Key, class Value>
+std::pair<const Key&, Value&> AVLMultiMap<Key, Value>::iterator::operator*() const
+{
+    return std::pair<const Key&, Value&>(node_->getKey(), node_->getValue()[index_]);
+}
+
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator::Arrow AVLMultiMap<Key, Value>::iterator::operator->() const
+{
+    Arrow arrow = { **this };
+    return arrow;
+}
+
+template<class Key, class Value>
+const Key& AVLMultiMap<Key, Value>::iterator::key() const
+{
+    return node_->getKey();
+}
+
+template<class Key, class Value>
+Value& AVLMultiMap<Key, Value>::iterator::value() const
+{
+    return node_->getValue()[index_];
+}
+
+template<class Key, class Value>
+bool AVLMultiMap<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return node_ == rhs.node_ && index_ == rhs.index_;
+}
+
+template<class Key, class Value>
+bool AVLMultiMap<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return !(*this == rhs);
+}
+
+/**
+* Next value of the same key, or the first value of the next key.
+*/
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator& AVLMultiMap<Key, Value>::iterator::operator++()
+{
+    if(++index_ == node_->getValue().size()) {
+        node_ = node_->getNext();
+        index_ = 0;
+    }
+    return *this;
+}
+
+/*
+  -------------------------------------------------
+  End implementations for AVLMultiMap::iterator.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value>
+AVLMultiMap<Key, Value>::AVLMultiMap() : size_(0)
+{
+}
+
+/**
+* Adds item.second under item.first, after any values already there. One
+* descent either finds the key's chunk to append to or the leaf position
+* for a new node.
+*/
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::insert(const std::pair<const Key, Value>& item)
+{
+  ChunkAVLNode* parent = nullptr;
+  ChunkAVLNode* node = static_cast<ChunkAVLNode*>(this->root_);
+  while (node != nullptr) {
+    if (item.first < node->getKey()) {
+      parent = node;
+      node = node->getLeft();
+    }
+    else if (node->getKey() < item.first) {
+      parent = node;
+      node = node->getRight();
+    }
+    else {
+      node->getValue().push_back(item.second);
+      ++size_;
+      return;
+    }
+  }
+
+  node = new ChunkAVLNode(item.first, MultiMapChunk<Value>(1, item.second), parent);
+  ++size_;
+  if (parent == nullptr) {
+    this->root_ = node;
+    return;
+  }
+  if (item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  this->insertFix(parent, node);
+}
+
+/**
+* Removes every value stored under key and returns how many there were.
+*/
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::erase(const Key& key)
+{
+  ChunkNode* node = this->internalFind(key);
+  if (node == nullptr) {
+    return 0;
+  }
+  size_t removed = node->getValue().size();
+  this->eraseNode(node);
+  size_ -= removed;
+  return removed;
+}
+
+/**
+* Removes the value pos refers to and returns an iterator to the one after
+* it. Later values of the same key shift down one, so iterators to them
+* now refer to the value after theirs. The key's node goes away with its
+* last value; removing it moves no other node, so iterators to other keys
+* stay valid.
+*/
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator AVLMultiMap<Key, Value>::erase(iterator pos)
+{
+  std::vector<Value>& chunk = pos.node_->getValue();
+  --size_;
+  if (chunk.size() > 1) {
+    chunk.erase(chunk.begin() + pos.index_);
+    if (pos.index_ < chunk.size()) {
+      return pos;
+    }
+    return iterator(pos.node_->getNext(), 0);
+  }
+  ChunkNode* next = pos.node_->getNext();
+  this->eraseNode(pos.node_);
+  return iterator(next, 0);
+}
+
+template<class Key, class Value>
+void AVLMultiMap<Key, Value>::clear()
+{
+  Base::clear();
+  size_ = 0;
+}
+
+/**
+* Number of values stored under key, in O(log n).
+*/
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::count(const Key& key) const
+{
+  ChunkNode* node = this->internalFind(key);
+  return node == nullptr ? 0 : node->getValue().size();
+}
+
+/**
+* Total number of values (not of distinct keys).
+*/
+template<class Key, class Value>
+size_t AVLMultiMap<Key, Value>::size() const
+{
+  return size_;
+}
+
+template<class Key, class Value>
+bool AVLMultiMap<Key, Value>::empty() const
+{
+  return size_ == 0;
+}
+
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator AVLMultiMap<Key, Value>::begin() const
+{
+  return iterator(this->getSmallestNode(), 0);
+}
+
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator AVLMultiMap<Key, Value>::end() const
+{
+  return iterator(nullptr, 0);
+}
+
+/**
+* The first value stored under key, or end().
+*/
+template<class Key, class Value>
+typename AVLMultiMap<Key, Value>::iterator AVLMultiMap<Key, Value>::find(const Key& key) const
+{
+  return iterator(this->internalFind(key), 0);
+}
+
+/**
+* All values stored under key, as [first, second). Both are end() if the
+* key is absent.
+*/
+template<class Key, class Value>
+std::pair<typename AVLMultiMap<Key, Value>::iterator, typename AVLMultiMap<Key, Value>::iterator>
+AVLMultiMap<Key, Value>::equalRange(const Key& key) const
+{
+  ChunkNode* node = this->internalFind(key);
+  if (node == nullptr) {
+    return std::make_pair(end(), end());
+  }
+  return std::make_pair(iterator(node, 0), iterator(node->getNext(), 0));
+}
+
+/**
+* Direct read access to the values stored under key, or NULL; handy for
+* scanning one key's values without going through iterators.
+*/
+template<class Key, class Value>
+const std::vector<Value>* AVLMultiMap<Key, Value>::values(const Key& key) const
+{
+  ChunkNode* node = this->internalFind(key);
+  return node == nullptr ? nullptr : &node->getValue();
+}
+
+/**
+* An ordered multiset: one node per distinct key holding how many copies
+* are present, so a repeated insert is a counter increment.
+*/
+template <class Key>
+class AVLMultiSet : protected AVLTree<Key, size_t>
+{
+    typedef AVLTree<Key, size_t> Base;
+    typedef Node<Key, size_t> CountNode;
+    typedef AVLNode<Key, size_t> CountAVLNode;
+
+public:
+    /**
+    * Visits each key as many times as it is present.
+    */
+    class iterator
+    {
+    public:
+        iterator() : node_(NULL), copy_(0) { }
+
+        const Key& operator*() const { return node_->getKey(); }
+        const Key* operator->() const { return &node_->getKey(); }
+        bool operator==(const iterator& rhs) const { return node_ == rhs.node_ && copy_ == rhs.copy_; }
+        bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+        iterator& operator++();
+
+    protected:
+        friend class AVLMultiSet<Key>;
+        iterator(CountNode* node) : node_(node), copy_(0) { }
+        CountNode* node_;
+        size_t copy_;
+    };
+
+    AVLMultiSet() : size_(0) { }
+
+    void insert(const Key& key);
+    size_t erase(const Key& key);
+    bool eraseOne(const Key& key);
+    void clear();
+
+    size_t count(const Key& key) const;
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    iterator begin() const { return iterator(this->getSmallestNode()); }
+    iterator end() const { return iterator(); }
+
+    using Base::isBalanced;
+
+private:
+    size_t size_;
+};
+
+template<class Key>
+typename AVLMultiSet<Key>::iterator& AVLMultiSet<Key>::iterator::operator++()
+{
+    if(++copy_ == node_->getValue()) {
+        node_ = node_->getNext();
+        copy_ = 0;
+    }
+    return *this;
+}
+
+/**
+* Adds a copy of key in a single descent, as AVLMultiMap::insert does.
+*/
+template<class Key>
+void AVLMultiSet<Key>::insert(const Key& key)
+{
+  CountAVLNode* parent = nullptr;
+  CountAVLNode* node = static_cast<CountAVLNode*>(this->root_);
+  while (node != nullptr) {
+    if (key < node->getKey()) {
+      parent = node;
+      node = node->getLeft();
+    }
+    else if (node->getKey() < key) {
+      parent = node;
+      node = node->getRight();
+    }
+    else {
+      ++node->getValue();
+      ++size_;
+      return;
+    }
+  }
+
+  node = new CountAVLNode(key, size_t(1), parent);
+  ++size_;
+  if (parent == nullptr) {
+    this->root_ = node;
+    return;
+  }
+  if (key < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  this->insertFix(parent, node);
+}
+
+/**
+* Removes every copy of key and returns how many there were.
+*/
+template<class Key>
+size_t AVLMultiSet<Key>::erase(const Key& key)
+{
+  CountNode* node = this->internalFind(key);
+  if (node == nullptr) {
+    return 0;
+  }
+  size_t removed = node->getValue();
+  this->eraseNode(node);
+  size_ -= removed;
+  return removed;
+}
+
+/**
+* Removes a single copy of key; false if there was none.
+*/
+template<class Key>
+bool AVLMultiSet<Key>::eraseOne(const Key& key)
+{
+  CountNode* node = this->internalFind(key);
+  if (node == nullptr) {
+    return false;
+  }
+  if (--node->getValue() == 0) {
+    this->eraseNode(node);
+  }
+  --size_;
+  return true;
+}
+
+template<class Key>
+void AVLMultiSet<Key>::clear()
+{
+  Base::clear();
+  size_ = 0;
+}
+
+template<class Key>
+size_t AVLMultiSet<Key>::count(const Key& key) const
+{
+  CountNode* node = this->internalFind(key);
+  return node == nullptr ? 0 : node->getValue();
+}
+
+#endif
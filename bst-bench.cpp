@@ -0,0 +1,599 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <sstream>
+#include <cstdlib>
+#include <cstring>
+#include <chrono>
+#include <random>
+#include <algorithm>
+#include <cstdint>
+#include <type_traits>
+#include <cmath>
+#include "bst.h"
+#include "avlbst.h"
+#include "bst-parallel.h"
+#include "compact-avlbst.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "wavlbst.h"
+#include "avlmultimap.h"
+#include "augmented-avlbst.h"
+#include "interval-tree.h"
+#include "string-avlbst.h"
+#include "small-avlmap.h"
+#include "perf-counters.h"
+
+using namespace std;
+
+// Set by -p; when false (or when perf events are not permitted) only
+// wall-clock time is reported.
+static PerfCounters* counters = NULL;
+
+// Keeps the optimizer from discarding lookups whose result is otherwise unused.
+static volatile uint64_t sink;
+
+/**
+ * Runs op once and prints the time and (optionally) hardware counters
+ * divided by the number of operations it performed.
+ */
+template<typename Op>
+void measure(const string& label, uint64_t ops, Op op)
+{
+    if(counters) counters->start();
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    op();
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    if(counters) counters->stop();
+
+    double ns = chrono::duration<double, nano>(end - begin).count();
+    cout << left << setw(34) << label << right << fixed << setprecision(1)
+         << setw(10) << ns / ops << " ns/op";
+    if(counters) {
+        for(int e = 0; e < PerfCounters::NUM_EVENTS; ++e) {
+            uint64_t count;
+            cout << setw(14);
+            if(counters->get(static_cast<PerfCounters::Event>(e), count)) {
+                cout << static_cast<double>(count) / ops;
+            }
+            else {
+                cout << "n/a";
+            }
+        }
+    }
+    cout << endl;
+}
+
+void printHeader()
+{
+    cout << left << setw(34) << "operation" << right << setw(16) << "time";
+    if(counters) {
+        for(int e = 0; e < PerfCounters::NUM_EVENTS; ++e) {
+            cout << setw(14) << PerfCounters::name(static_cast<PerfCounters::Event>(e));
+        }
+    }
+    cout << endl;
+}
+
+/**
+ * Parallel traversal only applies to the BinarySearchTree family.
+ */
+template<typename Tree>
+void benchParallel(const string& name, Tree& tree, uint64_t n, true_type)
+{
+    measure(name + " parallelReduce", n, [&]() {
+        sink = parallelReduce(tree, uint64_t(0),
+            [](const pair<const uint64_t, uint64_t>& p) { return p.second; },
+            [](uint64_t a, uint64_t b) { return a + b; });
+    });
+}
+
+template<typename Tree>
+void benchParallel(const string&, Tree&, uint64_t, false_type)
+{
+}
+
+/**
+ * Batched lookups, also BinarySearchTree family only.
+ */
+template<typename Tree>
+void benchFindMany(const string& name, Tree& tree, const vector<uint64_t>& probes, true_type)
+{
+    vector<typename Tree::iterator> out(probes.size());
+    measure(name + " findMany", probes.size(), [&]() {
+        tree.findMany(probes.data(), probes.size(), out.data());
+        uint64_t found = 0;
+        for(size_t i = 0; i < out.size(); ++i) {
+            found += (out[i] != tree.end());
+        }
+        sink = found;
+    });
+}
+
+template<typename Tree>
+void benchFindMany(const string&, Tree&, const vector<uint64_t>&, false_type)
+{
+}
+
+/**
+ * The standard insert / find / scan / remove workload for one tree type.
+ */
+template<typename Tree>
+void benchTree(const string& name, const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    Tree tree;
+    uint64_t n = keys.size();
+
+    measure(name + " insert", n, [&]() {
+        for(size_t i = 0; i < keys.size(); ++i) {
+            tree.insert(make_pair(keys[i], keys[i]));
+        }
+    });
+    measure(name + " find", probes.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            found += (tree.find(probes[i]) != tree.end());
+        }
+        sink = found;
+    });
+    benchFindMany(name, tree, probes, typename is_base_of<BinarySearchTree<uint64_t, uint64_t>, Tree>::type());
+    measure(name + " scan", n, [&]() {
+        uint64_t sum = 0;
+        for(typename Tree::iterator it = tree.begin(); it != tree.end(); ++it) {
+            sum += it->second;
+        }
+        sink = sum;
+    });
+    benchParallel(name, tree, n, typename is_base_of<BinarySearchTree<uint64_t, uint64_t>, Tree>::type());
+    measure(name + " remove", n, [&]() {
+        for(size_t i = 0; i < keys.size(); ++i) {
+            tree.remove(keys[i]);
+        }
+    });
+}
+
+/**
+ * A write-heavy steady state: the tree holds half the keys and every
+ * step removes one and inserts another.
+ */
+template<typename Tree>
+void benchChurn(const string& name, const vector<uint64_t>& keys)
+{
+    Tree tree;
+    size_t half = keys.size() / 2;
+    for(size_t i = 0; i < half; ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    measure(name + " churn", 2 * half, [&]() {
+        for(size_t i = 0; i < half; ++i) {
+            tree.remove(keys[i]);
+            tree.insert(make_pair(keys[half + i], keys[half + i]));
+        }
+    });
+}
+
+/**
+ * Lookups following a skewed trace, the case splay trees are made for.
+ */
+template<typename Tree>
+void benchSkewed(const string& name, Tree& tree, const vector<uint64_t>& keys, const vector<uint64_t>& trace)
+{
+    for(size_t i = 0; i < keys.size(); ++i) {
+        tree.insert(make_pair(keys[i], keys[i]));
+    }
+    measure(name + " zipf find", trace.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < trace.size(); ++i) {
+            found += (tree.find(trace[i]) != tree.end());
+        }
+        sink = found;
+    });
+}
+
+/**
+ * count draws of keys[rank], where rank follows a Zipf law with exponent s.
+ */
+vector<uint64_t> zipfTrace(const vector<uint64_t>& keys, size_t count, double s, mt19937_64& rng)
+{
+    vector<double> cdf(keys.size());
+    double total = 0;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        total += 1.0 / pow(static_cast<double>(i + 1), s);
+        cdf[i] = total;
+    }
+    uniform_real_distribution<double> dist(0, total);
+    vector<uint64_t> trace(count);
+    for(size_t i = 0; i < count; ++i) {
+        size_t rank = lower_bound(cdf.begin(), cdf.end(), dist(rng)) - cdf.begin();
+        trace[i] = keys[min(rank, keys.size() - 1)];
+    }
+    return trace;
+}
+
+/**
+ * URL-like keys that share long prefixes: std::string keys in an AVLTree
+ * vs. StringAVLTree's packed keys and prefix-skipping descent. The keys
+ * are random, so a lookup soon passes keys on both sides and both lcp
+ * bounds get set: this measures the good case, not the O(L log n) worst.
+ */
+void benchStrings(const vector<uint64_t>& keys, const vector<uint64_t>& probes)
+{
+    vector<string> urls(keys.size());
+    for(size_t i = 0; i < keys.size(); ++i) {
+        urls[i] = "https://static.example.com/assets/catalog/v2/" + to_string(keys[i] % 97)
+                + "/item-" + to_string(keys[i]);
+    }
+    size_t bytes = 0;
+    for(size_t i = 0; i < urls.size(); ++i) {
+        bytes += urls[i].size();
+    }
+    cout << "string keys, " << bytes / max<size_t>(urls.size(), 1) << " bytes avg, node bytes: AVLNode<string> "
+         << sizeof(AVLNode<string, uint64_t>) << ", AVLNode<PackedString> "
+         << sizeof(AVLNode<PackedString, uint64_t>) << " + " << sizeof(uint32_t) << " + key" << endl;
+
+    AVLTree<string, uint64_t> plain;
+    measure("AVLTree<string> insert", urls.size(), [&]() {
+        for(size_t i = 0; i < urls.size(); ++i) {
+            plain.insert(make_pair(urls[i], keys[i]));
+        }
+    });
+    measure("AVLTree<string> find", probes.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            found += (plain.find(urls[probes[i]]) != plain.end());
+        }
+        sink = found;
+    });
+    StringAVLTree<uint64_t> packed;
+    measure("StringAVLTree insert", urls.size(), [&]() {
+        for(size_t i = 0; i < urls.size(); ++i) {
+            packed.insert(urls[i], keys[i]);
+        }
+    });
+    measure("StringAVLTree find", probes.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            found += packed.contains(urls[probes[i]]);
+        }
+        sink = found;
+    });
+}
+
+int main(int argc, char *argv[])
+{
+    uint64_t n = 200000;
+    bool usePerf = false;
+    for(int i = 1; i < argc; ++i) {
+        if(strcmp(argv[i], "-p") == 0) {
+            usePerf = true;
+        }
+        else {
+            n = strtoull(argv[i], NULL, 10);
+        }
+    }
+    if(n == 0) {
+        cerr << "usage: " << argv[0] << " [-p] [num_keys]" << endl;
+        return 1;
+    }
+
+    PerfCounters perf;
+    if(usePerf) {
+        if(perf.available()) {
+            counters = &perf;
+        }
+        else {
+            cerr << "perf events not available (check /proc/sys/kernel/perf_event_paranoid), "
+                 << "reporting wall-clock time only" << endl;
+        }
+    }
+
+    mt19937_64 rng(104);
+    vector<uint64_t> keys(n);
+    for(uint64_t i = 0; i < n; ++i) {
+        keys[i] = i;
+    }
+    shuffle(keys.begin(), keys.end(), rng);
+    vector<uint64_t> probes(keys);
+    shuffle(probes.begin(), probes.end(), rng);
+
+    cout << n << " keys, node bytes: AVLNode " << sizeof(AVLNode<uint64_t, uint64_t>)
+         << ", compact " << CompactAVLTree<uint64_t, uint64_t>::nodeSize()
+         << ", compact/index " << CompactAVLTree<uint64_t, uint64_t, IndexNodeStore<uint64_t, uint64_t> >::nodeSize()
+         << endl;
+    printHeader();
+    benchTree<BinarySearchTree<uint64_t, uint64_t> >("BinarySearchTree", keys, probes);
+    benchTree<AVLTree<uint64_t, uint64_t> >("AVLTree", keys, probes);
+    benchTree<RBTree<uint64_t, uint64_t> >("RBTree", keys, probes);
+    benchTree<WAVLTree<uint64_t, uint64_t> >("WAVLTree", keys, probes);
+    benchTree<SplayTree<uint64_t, uint64_t> >("SplayTree", keys, probes);
+    benchChurn<AVLTree<uint64_t, uint64_t> >("AVLTree", keys);
+    benchChurn<RBTree<uint64_t, uint64_t> >("RBTree", keys);
+    benchChurn<WAVLTree<uint64_t, uint64_t> >("WAVLTree", keys);
+    benchTree<CompactAVLTree<uint64_t, uint64_t> >("CompactAVLTree", keys, probes);
+    benchTree<CompactAVLTree<uint64_t, uint64_t, IndexNodeStore<uint64_t, uint64_t> > >(
+        "CompactAVLTree/index", keys, probes);
+
+    vector<pair<uint64_t, uint64_t> > items(n);
+    for(uint64_t i = 0; i < n; ++i) {
+        items[i] = make_pair(keys[i], keys[i]);
+    }
+    AVLTree<uint64_t, uint64_t> built;
+    measure("AVLTree build", n, [&]() {
+        built.build(items);
+    });
+    AVLTree<uint64_t, uint64_t> evens, odds;
+    vector<pair<uint64_t, uint64_t> > evenItems, oddItems;
+    for(uint64_t i = 0; i < n; ++i) {
+        (i % 2 ? oddItems : evenItems).push_back(make_pair(i, i));
+    }
+    evens.build(evenItems);
+    odds.build(oddItems);
+    measure("AVLTree merge", n, [&]() {
+        evens.merge(std::move(odds));
+    });
+    measure("AVLTree eraseRange", n / 2, [&]() {
+        evens.eraseRange(n / 4, n / 4 + n / 2);
+    });
+
+    AVLTree<uint64_t, uint64_t> swept;
+    swept.build(items);
+    measure("AVLTree eraseIf odd", n, [&]() {
+        sink = swept.eraseIf([](const pair<const uint64_t, uint64_t>& item) { return item.first % 2 != 0; });
+    });
+    measure("AVLTree erase(iterator) scan", n / 2, [&]() {
+        for(AVLTree<uint64_t, uint64_t>::iterator it = swept.begin(); it != swept.end(); ) {
+            it = (it->first % 4 == 0) ? swept.erase(it) : ++it;
+        }
+    });
+
+    measure("AVLTree copy", n, [&]() {
+        AVLTree<uint64_t, uint64_t> copy(built);
+        sink = copy.empty();
+    });
+    measure("AVLTree copy by reinserting", n, [&]() {
+        AVLTree<uint64_t, uint64_t> copy;
+        for(AVLTree<uint64_t, uint64_t>::iterator it = built.begin(); it != built.end(); ++it) {
+            copy.insert(*it);
+        }
+        sink = copy.empty();
+    });
+
+    // migrate every other key to a second tree: remove + insert vs. extract + insert
+    {
+        AVLTree<uint64_t, uint64_t> hot, cold;
+        hot.build(items);
+        measure("AVLTree remove+insert move", n / 2, [&]() {
+            for(size_t i = 0; i < keys.size(); i += 2) {
+                uint64_t value = hot[keys[i]];
+                hot.remove(keys[i]);
+                cold.insert(make_pair(keys[i], value));
+            }
+        });
+        measure("AVLTree extract+insert move", n / 2, [&]() {
+            for(size_t i = 0; i < keys.size(); i += 2) {
+                hot.insert(cold.extract(keys[i]));
+            }
+        });
+    }
+
+    // keys is already shuffled, so hot ranks land on random keys
+    vector<uint64_t> trace = zipfTrace(keys, n, 1.1, rng);
+    {
+        AVLTree<uint64_t, uint64_t> avl;
+        benchSkewed("AVLTree", avl, keys, trace);
+        SplayTree<uint64_t, uint64_t> splay;
+        benchSkewed("SplayTree", splay, keys, trace);
+        SplayTree<uint64_t, uint64_t> every4(4);
+        benchSkewed("SplayTree every 4th", every4, keys, trace);
+        SplayTree<uint64_t, uint64_t> semi(1, true);
+        benchSkewed("SplayTree semi-splay", semi, keys, trace);
+    }
+
+    // lookups in an insertion-ordered heap layout vs. after relayout()
+    AVLTree<uint64_t, uint64_t> scattered;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        scattered.insert(make_pair(keys[i], keys[i]));
+    }
+    measure("AVLTree heap-layout find", probes.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            found += (scattered.find(probes[i]) != scattered.end());
+        }
+        sink = found;
+    });
+    const LayoutOrder orders[] = { LAYOUT_BFS, LAYOUT_VEB };
+    const char* orderNames[] = { "bfs", "veb" };
+    for(int o = 0; o < 2; ++o) {
+        measure(string("AVLTree relayout ") + orderNames[o], n, [&]() {
+            scattered.relayout(orders[o]);
+        });
+        measure(string("AVLTree ") + orderNames[o] + "-layout find", probes.size(), [&]() {
+            uint64_t found = 0;
+            for(size_t i = 0; i < probes.size(); ++i) {
+                found += (scattered.find(probes[i]) != scattered.end());
+            }
+            sink = found;
+        });
+    }
+
+    // churn an index-based tree, then compare lookups before and after compact()
+    typedef CompactAVLTree<uint64_t, uint64_t, IndexNodeStore<uint64_t, uint64_t> > IndexTree;
+    IndexTree churned;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        churned.insert(make_pair(keys[i], keys[i]));
+    }
+    for(size_t i = 0; i < keys.size(); i += 2) {
+        churned.remove(keys[i]);
+    }
+    measure("CompactAVLTree/index churned find", probes.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            found += (churned.find(probes[i]) != churned.end());
+        }
+        sink = found;
+    });
+    measure("CompactAVLTree/index compact", n / 2, [&]() {
+        churned.compact(COMPACT_BFS);
+    });
+    measure("CompactAVLTree/index compact find", probes.size(), [&]() {
+        uint64_t found = 0;
+        for(size_t i = 0; i < probes.size(); ++i) {
+            found += (churned.find(probes[i]) != churned.end());
+        }
+        sink = found;
+    });
+
+    // trivially copyable entries: memcpy copy and raw save/load of the pool vs. reinserting
+    IndexTree pooled;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        pooled.insert(make_pair(keys[i], keys[i]));
+    }
+    measure("CompactAVLTree/index copy", n, [&]() {
+        IndexTree copy(pooled);
+        sink = copy.size();
+    });
+    measure("CompactAVLTree/index reinsert", n, [&]() {
+        IndexTree copy;
+        for(IndexTree::iterator it = pooled.begin(); it != pooled.end(); ++it) {
+            copy.insert(*it);
+        }
+        sink = copy.size();
+    });
+    measure("CompactAVLTree/index save+load", n, [&]() {
+        stringstream bytes;
+        pooled.save(bytes);
+        IndexTree loaded;
+        loaded.load(bytes);
+        sink = loaded.size();
+    });
+
+    // range sums over a window of n/100 keys: walking the range vs. aggregate()
+    {
+        AugmentedAVLTree<uint64_t, uint64_t> summed;
+        AVLTree<uint64_t, uint64_t> plain;
+        for(size_t i = 0; i < keys.size(); ++i) {
+            summed.insert(make_pair(keys[i], keys[i]));
+            plain.insert(make_pair(keys[i], keys[i]));
+        }
+        uint64_t window = max<uint64_t>(n / 100, 1);
+        size_t queries = min<size_t>(probes.size(), 10000);
+        measure("AVLTree range sum scan", queries, [&]() {
+            uint64_t total = 0;
+            for(size_t i = 0; i < queries; ++i) {
+                AVLTree<uint64_t, uint64_t>::iterator it = plain.find(probes[i]);
+                for(uint64_t k = 0; it != plain.end() && k < window; ++k, ++it) {
+                    total += it->second;
+                }
+            }
+            sink = total;
+        });
+        measure("AugmentedAVLTree aggregate", queries, [&]() {
+            uint64_t total = 0;
+            for(size_t i = 0; i < queries; ++i) {
+                total += summed.aggregate(probes[i], probes[i] + window);
+            }
+            sink = total;
+        });
+    }
+
+    // intervals of length < 64 starting at each key: overlap queries vs. a scan keyed by start
+    {
+        IntervalTree<uint64_t> intervals;
+        AVLTree<uint64_t, uint64_t> byStart;
+        for(size_t i = 0; i < keys.size(); ++i) {
+            intervals.insert(keys[i], keys[i] + keys[i] % 64);
+            byStart.insert(make_pair(keys[i], keys[i] + keys[i] % 64));
+        }
+        size_t queries = min<size_t>(probes.size(), 10000);
+        size_t scans = min<size_t>(queries, 100); // each one walks half the tree
+        measure("AVLTree<Start, End> overlap scan", scans, [&]() {
+            uint64_t found = 0;
+            for(size_t i = 0; i < scans; ++i) {
+                for(AVLTree<uint64_t, uint64_t>::iterator it = byStart.begin();
+                    it != byStart.end() && it->first <= probes[i] + 16; ++it) {
+                    found += (it->second >= probes[i]);
+                }
+            }
+            sink = found;
+        });
+        vector<IntervalTree<uint64_t>::iterator> hits;
+        measure("IntervalTree overlaps", queries, [&]() {
+            uint64_t found = 0;
+            for(size_t i = 0; i < queries; ++i) {
+                hits.clear();
+                found += intervals.overlaps(probes[i], probes[i] + 16, hits);
+            }
+            sink = found;
+        });
+    }
+
+    // many values per key: copy-and-replace a vector value vs. AVLMultiMap
+    uint64_t distinct = max<uint64_t>(n / 64, 1);
+    {
+        // MultiMapChunk is just a vector that print() can stream
+        typedef AVLTree<uint64_t, MultiMapChunk<uint64_t> > CopyingTree;
+        CopyingTree copying;
+        measure("AVLTree<vector> append", n, [&]() {
+            for(uint64_t i = 0; i < n; ++i) {
+                CopyingTree::iterator it = copying.find(keys[i] % distinct);
+                MultiMapChunk<uint64_t> values;
+                if(it != copying.end()) {
+                    values = it->second;
+                }
+                values.push_back(keys[i]);
+                copying.insert(make_pair(keys[i] % distinct, values));
+            }
+        });
+        AVLMultiMap<uint64_t, uint64_t> multi;
+        measure("AVLMultiMap append", n, [&]() {
+            for(uint64_t i = 0; i < n; ++i) {
+                multi.insert(make_pair(keys[i] % distinct, keys[i]));
+            }
+        });
+        measure("AVLMultiMap count", probes.size(), [&]() {
+            uint64_t total = 0;
+            for(size_t i = 0; i < probes.size(); ++i) {
+                total += multi.count(probes[i] % distinct);
+            }
+            sink = total;
+        });
+    }
+
+    // many maps of 8 entries each: one AVLTree per map vs. SmallAVLMap's inline array
+    {
+        size_t maps = max<size_t>(n / 8, 1);
+        vector<AVLTree<uint64_t, uint64_t> > trees(maps);
+        vector<SmallAVLMap<uint64_t, uint64_t> > smalls(maps);
+        measure("AVLTree x8 insert", n, [&]() {
+            for(size_t i = 0; i < keys.size(); ++i) {
+                trees[keys[i] % maps].insert(make_pair(keys[i], keys[i]));
+            }
+        });
+        measure("AVLTree x8 find", probes.size(), [&]() {
+            uint64_t found = 0;
+            for(size_t i = 0; i < probes.size(); ++i) {
+                AVLTree<uint64_t, uint64_t>& tree = trees[probes[i] % maps];
+                found += (tree.find(probes[i]) != tree.end());
+            }
+            sink = found;
+        });
+        measure("SmallAVLMap x8 insert", n, [&]() {
+            for(size_t i = 0; i < keys.size(); ++i) {
+                smalls[keys[i] % maps].insert(make_pair(keys[i], keys[i]));
+            }
+        });
+        measure("SmallAVLMap x8 find", probes.size(), [&]() {
+            uint64_t found = 0;
+            for(size_t i = 0; i < probes.size(); ++i) {
+                SmallAVLMap<uint64_t, uint64_t>& small = smalls[probes[i] % maps];
+                found += (small.find(probes[i]) != small.end());
+            }
+            sink = found;
+        });
+    }
+
+    benchStrings(keys, probes);
+
+    return 0;
+}
@@ -0,0 +1,1014 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+#include "augmented-avlbst.h"
+#include "bst-parallel.h"
+#include "compact-avlbst.h"
+#include "interval-tree.h"
+#include "small-avlmap.h"
+#include "splaybst.h"
+#include "rbbst.h"
+#include "wavlbst.h"
+
+using namespace std;
+
+// Self-checking tests: unlike bst-test, which prints for a human to read,
+// every check here is compared against std::map or a structural invariant
+// and the exit status says whether all of them held.
+
+static int failures = 0;
+
+#define CHECK(cond) \
+    do { \
+        if(!(cond)) { \
+            cerr << __FILE__ << ":" << __LINE__ << ": CHECK(" #cond ") failed" << endl; \
+            ++failures; \
+        } \
+    } while(0)
+
+/**
+ * A tree with its root made visible, so the checks below can walk the
+ * nodes themselves rather than trust the iterator.
+ */
+template<template<class, class> class Tree, class Key, class Value>
+class Probe : public Tree<Key, Value>
+{
+public:
+    using Tree<Key, Value>::Tree;
+    Node<Key, Value>* root() const { return this->root_; }
+};
+
+/**
+ * Parent links agree with child links, keys increase strictly in order,
+ * and the successor chain (what the iterator follows) is that same order.
+ */
+template<class Key, class Value>
+bool linksHold(Node<Key, Value>* root)
+{
+    if(root != NULL && root->getParent() != NULL) {
+        return false;
+    }
+    vector<Node<Key, Value>*> stack;
+    Node<Key, Value>* prev = NULL;
+    Node<Key, Value>* node = root;
+    while(node != NULL || !stack.empty()) {
+        for(; node != NULL; node = node->getLeft()) {
+            if(node->getLeft() && node->getLeft()->getParent() != node) return false;
+            if(node->getRight() && node->getRight()->getParent() != node) return false;
+            stack.push_back(node);
+        }
+        node = stack.back();
+        stack.pop_back();
+        if(prev != NULL && (!(prev->getKey() < node->getKey()) || prev->getNext() != node)) {
+            return false;
+        }
+        prev = node;
+        node = node->getRight();
+    }
+    return prev == NULL || prev->getNext() == NULL;
+}
+
+/**
+ * Height of an AVL subtree, or -2 if some stored balance is wrong.
+ */
+template<class Key, class Value>
+int avlHeight(AVLNode<Key, Value>* node)
+{
+    if(node == NULL) {
+        return 0;
+    }
+    int left = avlHeight(node->getLeft());
+    int right = avlHeight(node->getRight());
+    if(left < 0 || right < 0 || right - left != node->getBalance() || right - left > 1 || left - right > 1) {
+        return -2;
+    }
+    return 1 + max(left, right);
+}
+
+template<class Key, class Value>
+bool avlHolds(Node<Key, Value>* root)
+{
+    return linksHold(root) && avlHeight(static_cast<AVLNode<Key, Value>*>(root)) >= 0;
+}
+
+template<class Tree, class Key, class Value>
+bool sameAs(const Tree& tree, const map<Key, Value>& expected)
+{
+    typename Tree::iterator it = tree.begin();
+    for(typename map<Key, Value>::const_iterator e = expected.begin(); e != expected.end(); ++e, ++it) {
+        if(it == tree.end() || it->first != e->first || it->second != e->second) {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+typedef Probe<AVLTree, int, int> AVLProbe;
+
+/**
+ * A random AVL tree over keys in [0, range) and the same entries in a map;
+ * laid out in one block first when layout is set.
+ */
+void randomAVL(AVLProbe& tree, map<int, int>& expected, int count, int range, bool layout, mt19937& rng)
+{
+    tree.clear();
+    expected.clear();
+    for(int i = 0; i < count; ++i) {
+        int key = static_cast<int>(rng() % range);
+        tree.insert(make_pair(key, i));
+        expected[key] = i;
+    }
+    if(layout) {
+        tree.relayout(rng() % 2 ? LAYOUT_VEB : LAYOUT_BFS);
+    }
+}
+
+/**
+ * AVLTree::split, join, eraseRange and extractRange against std::map, on
+ * heap-allocated and on relayout()'d trees (whose blocks end up shared
+ * between the pieces).
+ */
+void checkJoinSplit()
+{
+    mt19937 rng(28);
+    for(int round = 0; round < 200; ++round) {
+        bool layout = round % 2 != 0;
+        int range = 1 + static_cast<int>(rng() % 300);
+        AVLProbe tree;
+        map<int, int> expected;
+        randomAVL(tree, expected, static_cast<int>(rng() % 200), range, layout, rng);
+
+        // split: keys below key go left, key itself and above go right
+        int key = static_cast<int>(rng() % (range + 2)) - 1;
+        AVLProbe left, right;
+        left.insert(make_pair(-100, 0)); // discarded by split
+        tree.split(key, left, right);
+        map<int, int> below(expected.begin(), expected.lower_bound(key));
+        map<int, int> above(expected.lower_bound(key), expected.end());
+        CHECK(tree.empty());
+        CHECK(avlHolds(left.root()) && sameAs(left, below));
+        CHECK(avlHolds(right.root()) && sameAs(right, above));
+
+        // join refuses an item that is not strictly between the two sides
+        right.remove(key);
+        above.erase(key);
+        if(!below.empty()) {
+            bool threw = false;
+            try {
+                tree.join(left, make_pair(below.rbegin()->first, 0), right);
+            }
+            catch(invalid_argument&) {
+                threw = true;
+            }
+            CHECK(threw);
+            CHECK(sameAs(left, below) && sameAs(right, above));
+        }
+        if(!above.empty()) {
+            bool threw = false;
+            try {
+                tree.join(left, make_pair(above.begin()->first + 1, 0), right);
+            }
+            catch(invalid_argument&) {
+                threw = true;
+            }
+            CHECK(threw);
+            CHECK(sameAs(left, below) && sameAs(right, above));
+        }
+        tree.join(left, make_pair(key, -1), right);
+        expected[key] = -1;
+        CHECK(left.empty() && right.empty());
+        CHECK(avlHolds(tree.root()) && sameAs(tree, expected));
+
+        // the pieces of a laid-out tree stay usable after joining
+        for(int i = 0; i < 20; ++i) {
+            int k = static_cast<int>(rng() % range);
+            if(rng() % 2) {
+                tree.insert(make_pair(k, i));
+                expected[k] = i;
+            }
+            else {
+                tree.remove(k);
+                expected.erase(k);
+            }
+        }
+        CHECK(avlHolds(tree.root()) && sameAs(tree, expected));
+
+        // eraseRange and extractRange take [lo, hi)
+        int lo = static_cast<int>(rng() % (range + 2)) - 1;
+        int hi = lo + static_cast<int>(rng() % (range / 2 + 2)) - 1;
+        AVLProbe copy(tree);
+        map<int, int> rest(expected);
+        if(lo < hi) {
+            rest.erase(rest.lower_bound(lo), rest.lower_bound(hi));
+        }
+        tree.eraseRange(lo, hi);
+        CHECK(avlHolds(tree.root()) && sameAs(tree, rest));
+
+        if(layout) {
+            copy.relayout();
+        }
+        AVLProbe out;
+        out.insert(make_pair(-100, 0)); // replaced by extractRange
+        copy.extractRange(lo, hi, out);
+        map<int, int> cut;
+        if(lo < hi) {
+            cut.insert(expected.lower_bound(lo), expected.lower_bound(hi));
+        }
+        CHECK(avlHolds(copy.root()) && sameAs(copy, rest));
+        CHECK(avlHolds(out.root()) && sameAs(out, cut));
+        out.insert(make_pair(range + 1, 0));
+        cut[range + 1] = 0;
+        copy.remove(lo);
+        rest.erase(lo);
+        CHECK(avlHolds(out.root()) && sameAs(out, cut));
+        CHECK(avlHolds(copy.root()) && sameAs(copy, rest));
+    }
+}
+
+/**
+ * AVLTree::merge against std::map, with the other tree's entry winning on
+ * a shared key, for sizes far apart and alike, laid out or not, and with
+ * and without worker threads.
+ */
+void checkMerge()
+{
+    mt19937 rng(27);
+    for(int round = 0; round < 200; ++round) {
+        int range = 1 + static_cast<int>(rng() % 2000);
+        AVLProbe mine, theirs;
+        map<int, int> expected, other;
+        randomAVL(mine, expected, static_cast<int>(rng() % (round % 3 == 0 ? 8 : 600)), range, round % 2 != 0, rng);
+        randomAVL(theirs, other, static_cast<int>(rng() % (round % 3 == 1 ? 8 : 600)), range, round % 4 < 2, rng);
+        for(map<int, int>::iterator it = other.begin(); it != other.end(); ++it) {
+            expected[it->first] = it->second + 10000;
+        }
+        for(AVLProbe::iterator it = theirs.begin(); it != theirs.end(); ++it) {
+            it->second += 10000;
+        }
+        mine.merge(std::move(theirs), round % 5);
+        CHECK(theirs.empty());
+        CHECK(avlHolds(mine.root()) && sameAs(mine, expected));
+
+        // the result takes ordinary updates afterwards
+        int key = static_cast<int>(rng() % range);
+        mine.remove(key);
+        expected.erase(key);
+        mine.insert(make_pair(range, 0));
+        expected[range] = 0;
+        CHECK(avlHolds(mine.root()) && sameAs(mine, expected));
+    }
+}
+
+/**
+ * Depth of a tree's deepest node, 0 for a lone root and -1 when empty.
+ */
+template<class Key, class Value>
+int depthOf(Node<Key, Value>* node)
+{
+    if(node == NULL) {
+        return -1;
+    }
+    return 1 + max(depthOf(node->getLeft()), depthOf(node->getRight()));
+}
+
+/**
+ * SplayTree lookups that miss still splay: after ascending inserts leave a
+ * path, misses below the minimum bring the path's end to the root on the
+ * splayEvery-th lookup and roughly halve the path's depth.
+ */
+void checkSplayMiss()
+{
+    typedef Probe<SplayTree, int, int> SplayProbe;
+    const int count = 1000;
+    for(unsigned int every = 1; every <= 3; ++every) {
+        SplayProbe tree(every);
+        for(int i = 0; i < count; ++i) {
+            tree.insert(make_pair(i, i));
+        }
+        CHECK(depthOf(tree.root()) == count - 1);
+
+        for(unsigned int miss = 1; miss < every; ++miss) {
+            CHECK(tree.find(-1) == tree.end());
+            CHECK(depthOf(tree.root()) == count - 1);
+        }
+        CHECK(tree.find(-1) == tree.end());
+        CHECK(linksHold(tree.root()) && tree.root()->getKey() == 0);
+        CHECK(depthOf(tree.root()) <= count / 2 + 1);
+
+        // operator[] splays on the miss before it throws
+        for(unsigned int miss = 1; miss <= every; ++miss) {
+            bool threw = false;
+            try {
+                tree[count];
+            }
+            catch(out_of_range&) {
+                threw = true;
+            }
+            CHECK(threw);
+        }
+        CHECK(linksHold(tree.root()) && tree.root()->getKey() == count - 1);
+    }
+}
+
+static_assert(is_const<remove_reference<decltype(*declval<AugmentedAVLTree<int, int>::iterator>())>::type>::value,
+    "AugmentedAVLTree hands out read-only entries");
+static_assert(is_const<remove_reference<decltype(*declval<IntervalTree<int, int>::iterator>())>::type>::value,
+    "IntervalTree hands out read-only entries");
+
+/**
+ * AugmentedAVLTree::assign against sums over a std::map: every summary on
+ * the way up is refreshed. IntervalTree::assign replaces the value only.
+ */
+void checkAugmentedAssign()
+{
+    mt19937 rng(46);
+    AugmentedAVLTree<int, int> tree;
+    map<int, int> expected;
+    for(int i = 0; i < 500; ++i) {
+        int key = static_cast<int>(rng() % 300);
+        tree.insert(make_pair(key, i));
+        expected[key] = i;
+    }
+    for(int round = 0; round < 500; ++round) {
+        int key = static_cast<int>(rng() % 300);
+        AugmentedAVLTree<int, int>::iterator it = tree.find(key);
+        CHECK((it == tree.end()) == (expected.count(key) == 0));
+        if(it != tree.end()) {
+            tree.assign(it, round);
+            expected[key] = round;
+            CHECK(it->second == round);
+        }
+        int lo = static_cast<int>(rng() % 300);
+        int hi = lo + static_cast<int>(rng() % 100);
+        int sum = 0;
+        for(map<int, int>::iterator e = expected.lower_bound(lo); e != expected.lower_bound(hi); ++e) {
+            sum += e->second;
+        }
+        CHECK(tree.aggregate(lo, hi) == sum);
+    }
+    CHECK(tree.isBalanced() && sameAs(tree, expected));
+
+    IntervalTree<int, int> intervals;
+    for(int i = 0; i < 100; ++i) {
+        intervals.insert(i, i + 10, i);
+    }
+    vector<IntervalTree<int, int>::iterator> hits;
+    CHECK(intervals.stab(50, hits) == 11);
+    for(size_t i = 0; i < hits.size(); ++i) {
+        intervals.assign(hits[i], -1);
+    }
+    hits.clear();
+    intervals.overlaps(40, 60, hits);
+    for(size_t i = 0; i < hits.size(); ++i) {
+        CHECK((hits[i]->second == -1) == (hits[i]->first.start >= 40 && hits[i]->first.start <= 50));
+    }
+}
+
+/**
+ * An exception thrown by the callback on any worker, including the calling
+ * thread, comes out of parallelForEach/parallelReduce instead of ending
+ * the process, and only once no task still refers to a finished frame.
+ */
+void checkParallelThrows()
+{
+    AVLTree<int, int> tree;
+    for(int i = 0; i < 5000; ++i) {
+        tree.insert(make_pair(i, i));
+    }
+    // bad == -1: every call throws, so stolen tasks throw on the other workers too
+    for(int bad = -1; bad < 5000; bad += 500) {
+        for(unsigned int threads = 1; threads <= 4; threads *= 2) {
+            bool threw = false;
+            try {
+                parallelForEach(tree, [bad](pair<const int, int>& item) {
+                    if(bad < 0) this_thread::yield(); // let the other workers steal
+                    if(bad < 0 || item.first == bad) throw runtime_error("forEach");
+                }, threads);
+            }
+            catch(runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+
+            threw = false;
+            try {
+                parallelReduce(tree, 0, [bad](const pair<const int, int>& item) {
+                    if(bad < 0) this_thread::yield(); // let the other workers steal
+                    if(bad < 0 || item.first == bad) throw runtime_error("map");
+                    return item.second;
+                }, [](int a, int b) { return a + b; }, threads);
+            }
+            catch(runtime_error&) {
+                threw = true;
+            }
+            CHECK(threw);
+        }
+    }
+    int sum = parallelReduce(tree, 0, [](const pair<const int, int>& item) { return item.second; },
+        [](int a, int b) { return a + b; }, 4);
+    CHECK(sum == 4999 * 5000 / 2);
+}
+
+/**
+ * Black height of a red-black subtree, or -1 if a red node has a red
+ * child or two paths below it count different numbers of black nodes.
+ */
+template<class Key, class Value>
+int blackHeight(RBNode<Key, Value>* node)
+{
+    if(node == NULL) {
+        return 1;
+    }
+    bool red = node->getColor() == RBNode<Key, Value>::RED;
+    if(red && ((node->getLeft() && node->getLeft()->getColor() == RBNode<Key, Value>::RED)
+            || (node->getRight() && node->getRight()->getColor() == RBNode<Key, Value>::RED))) {
+        return -1;
+    }
+    int left = blackHeight(node->getLeft());
+    int right = blackHeight(node->getRight());
+    if(left < 0 || left != right) {
+        return -1;
+    }
+    return left + (red ? 0 : 1);
+}
+
+template<class Key, class Value>
+bool rbHolds(Node<Key, Value>* root)
+{
+    RBNode<Key, Value>* top = static_cast<RBNode<Key, Value>*>(root);
+    return linksHold(root) && (top == NULL || top->getColor() == RBNode<Key, Value>::BLACK)
+        && blackHeight(top) > 0;
+}
+
+/**
+ * WAVL rank rule: every rank difference to a child is 1 or 2, a missing
+ * child counting as rank -1, and leaves have rank 0.
+ */
+template<class Key, class Value>
+bool ranksHold(WAVLNode<Key, Value>* node)
+{
+    if(node == NULL) {
+        return true;
+    }
+    WAVLNode<Key, Value>* children[2] = { node->getLeft(), node->getRight() };
+    for(int i = 0; i < 2; ++i) {
+        int diff = node->getRank() - (children[i] ? children[i]->getRank() : -1);
+        if(diff != 1 && diff != 2) {
+            return false;
+        }
+    }
+    if(children[0] == NULL && children[1] == NULL && node->getRank() != 0) {
+        return false;
+    }
+    return ranksHold(children[0]) && ranksHold(children[1]);
+}
+
+template<class Key, class Value>
+bool wavlHolds(Node<Key, Value>* root)
+{
+    return linksHold(root) && ranksHold(static_cast<WAVLNode<Key, Value>*>(root));
+}
+
+/**
+ * Whether tree.insert(handle) compiles for a Handle rvalue.
+ */
+template<class Tree, class Handle>
+class TakesHandle
+{
+    template<class T>
+    static char test(decltype(declval<T&>().insert(declval<Handle>()))*);
+    template<class T>
+    static long test(...);
+
+public:
+    static const bool value = sizeof(test<Tree>(0)) == sizeof(char);
+};
+
+static_assert(TakesHandle<AVLTree<int, int>, AVLTree<int, int>::node_type>::value, "AVLTree takes its own handles");
+static_assert(!TakesHandle<AVLTree<int, int>, BinarySearchTree<int, int>::node_type>::value, "AVLTree refuses other trees' handles");
+static_assert(!TakesHandle<RBTree<int, int>, WAVLTree<int, int>::node_type>::value, "RBTree refuses other trees' handles");
+static_assert(!TakesHandle<WAVLTree<int, int>, RBTree<int, int>::node_type>::value, "WAVLTree refuses other trees' handles");
+
+/**
+ * relayout() where the tree has it.
+ */
+template<class Tree>
+void relayoutIfAVL(Tree& tree, mt19937& rng)
+{
+    (void)tree;
+    (void)rng;
+}
+
+void relayoutIfAVL(AVLProbe& tree, mt19937& rng)
+{
+    tree.relayout(rng() % 2 ? LAYOUT_VEB : LAYOUT_BFS);
+}
+
+/**
+ * extract() from one tree and insert() into another of the same type,
+ * by key and by iterator, colliding keys included, with some handles
+ * dropped unused; then the source goes away first. With layout set the
+ * source is relayout()'d, so its nodes live in a block the destination
+ * has to keep alive.
+ */
+template<class Tree, class Holds>
+void moveHandles(Holds holds, bool layout, mt19937& rng)
+{
+    Tree from, to;
+    map<int, int> fromExpected, toExpected;
+    int range = 1 + static_cast<int>(rng() % 300);
+    for(int i = 0; i < 200; ++i) {
+        int key = static_cast<int>(rng() % range);
+        from.insert(make_pair(key, i));
+        fromExpected[key] = i;
+        key = static_cast<int>(rng() % range);
+        to.insert(make_pair(key, -i));
+        toExpected[key] = -i;
+    }
+    if(layout) {
+        relayoutIfAVL(from, rng);
+    }
+    for(int i = 0; i < 100; ++i) {
+        int key = static_cast<int>(rng() % range);
+        typename Tree::node_type handle;
+        if(rng() % 2) {
+            handle = from.extract(key);
+        }
+        else {
+            typename Tree::iterator it = from.find(key);
+            if(it != from.end()) {
+                handle = from.extract(it);
+            }
+        }
+        CHECK(handle.empty() == (fromExpected.count(key) == 0));
+        if(handle.empty()) {
+            continue;
+        }
+        CHECK(handle.key() == key && handle.value() == fromExpected[key]);
+        int value = fromExpected[key];
+        fromExpected.erase(key);
+        if(rng() % 5 == 0) {
+            continue; // dropped: the handle frees the node
+        }
+        bool present = toExpected.count(key) != 0;
+        typename Tree::iterator at = to.insert(std::move(handle));
+        CHECK(at != to.end() && at->first == key);
+        CHECK(handle.empty() == !present);
+        if(!present) {
+            toExpected[key] = value;
+        }
+        CHECK(holds(from.root()) && sameAs(from, fromExpected));
+        CHECK(holds(to.root()) && sameAs(to, toExpected));
+    }
+    from.clear();
+    CHECK(holds(to.root()) && sameAs(to, toExpected));
+    for(int i = 0; i < 50; ++i) {
+        int key = static_cast<int>(rng() % range);
+        to.remove(key);
+        toExpected.erase(key);
+    }
+    CHECK(holds(to.root()) && sameAs(to, toExpected));
+}
+
+void checkHandles()
+{
+    mt19937 rng(44);
+    for(int round = 0; round < 20; ++round) {
+        moveHandles<AVLProbe>(avlHolds<int, int>, round % 2 == 0, rng);
+        moveHandles<Probe<RBTree, int, int> >(rbHolds<int, int>, false, rng);
+        moveHandles<Probe<WAVLTree, int, int> >(wavlHolds<int, int>, false, rng);
+    }
+}
+
+typedef CompactAVLTree<int, int, IndexNodeStore<int, int> > IndexTree;
+
+/**
+ * Whether loading bytes into an IndexTree throws runtime_error.
+ */
+bool loadThrows(const string& bytes)
+{
+    IndexTree tree;
+    istringstream in(bytes);
+    try {
+        tree.load(in);
+    }
+    catch(const runtime_error&) {
+        return true;
+    }
+    return false;
+}
+
+/**
+ * Reads or writes the uint32 at offset in a save()d image.
+ */
+uint32_t wordAt(const string& bytes, size_t offset)
+{
+    uint32_t word;
+    memcpy(&word, bytes.data() + offset, sizeof(word));
+    return word;
+}
+
+void setWordAt(string& bytes, size_t offset, uint32_t word)
+{
+    memcpy(&bytes[offset], &word, sizeof(word));
+}
+
+/**
+ * CompactAVLTree on an index pool: copies (memcpy for int entries, entry
+ * by entry for strings) and save()/load() round trips against std::map,
+ * with free slots in the pool; and load() refusing damaged images.
+ */
+void checkCompactRoundTrip()
+{
+    mt19937 rng(49);
+    for(int round = 0; round < 20; ++round) {
+        IndexTree tree;
+        CompactAVLTree<string, int, IndexNodeStore<string, int> > named;
+        map<int, int> expected;
+        map<string, int> namedExpected;
+        int range = 1 + static_cast<int>(rng() % 400);
+        for(int step = 0; step < 600; ++step) {
+            int key = static_cast<int>(rng() % range);
+            if(rng() % 3) {
+                tree.insert(make_pair(key, step));
+                expected[key] = step;
+                named.insert(make_pair(to_string(key), step));
+                namedExpected[to_string(key)] = step;
+            }
+            else {
+                tree.remove(key);
+                expected.erase(key);
+                named.remove(to_string(key));
+                namedExpected.erase(to_string(key));
+            }
+        }
+
+        IndexTree copy(tree);
+        CHECK(copy.size() == expected.size() && sameAs(copy, expected));
+        CompactAVLTree<string, int, IndexNodeStore<string, int> > namedCopy;
+        namedCopy = named;
+        CHECK(sameAs(namedCopy, namedExpected) && sameAs(named, namedExpected));
+
+        ostringstream out;
+        tree.save(out);
+        string bytes = out.str();
+        IndexTree loaded;
+        loaded.insert(make_pair(-1, -1)); // replaced by load()
+        istringstream in(bytes);
+        loaded.load(in);
+        CHECK(loaded.size() == expected.size() && sameAs(loaded, expected));
+
+        // the loaded pool, free list included, keeps working
+        for(int step = 0; step < 200; ++step) {
+            int key = static_cast<int>(rng() % range);
+            if(rng() % 2) {
+                loaded.insert(make_pair(key, -step));
+                expected[key] = -step;
+            }
+            else {
+                loaded.remove(key);
+                expected.erase(key);
+            }
+        }
+        CHECK(loaded.size() == expected.size() && sameAs(loaded, expected));
+
+        // damage: header[0] is sizeof(Slot), header[1] the slot count; each
+        // slot is the item, then left, right and parentBalance
+        const size_t header = 5 * sizeof(uint64_t);
+        uint64_t slotSize, slots;
+        memcpy(&slotSize, bytes.data(), sizeof(slotSize));
+        memcpy(&slots, bytes.data() + sizeof(uint64_t), sizeof(slots));
+        CHECK(slotSize == 5 * sizeof(uint32_t) && bytes.size() == header + slots * slotSize);
+        CHECK(!loadThrows(bytes));
+        CHECK(loadThrows(bytes.substr(0, bytes.size() - 1)));
+        string liveCount = bytes;
+        setWordAt(liveCount, 4 * sizeof(uint64_t), wordAt(bytes, 4 * sizeof(uint64_t)) + 1);
+        CHECK(loadThrows(liveCount));
+        for(uint64_t i = 0; i < slots; ++i) {
+            size_t at = header + i * slotSize;
+            size_t left = at + 8, right = at + 12, parentBalance = at + 16;
+            string bad = bytes;
+            if(wordAt(bytes, parentBalance) == 0xFFFFFFFF) {
+                setWordAt(bad, at, static_cast<uint32_t>(i + 1)); // free list loops on itself
+                CHECK(loadThrows(bad));
+                continue;
+            }
+            setWordAt(bad, left, static_cast<uint32_t>(slots + 1));
+            CHECK(loadThrows(bad));
+            bad = bytes;
+            setWordAt(bad, right, wordAt(bytes, left)); // both children the same node, or a stray one
+            CHECK(loadThrows(bad) == (wordAt(bytes, left) != wordAt(bytes, right)));
+            bad = bytes;
+            setWordAt(bad, parentBalance, wordAt(bytes, parentBalance) ^ (1u << 3)); // wrong parent
+            CHECK(loadThrows(bad));
+            bad = bytes;
+            uint32_t tag = wordAt(bytes, parentBalance) & 7;
+            setWordAt(bad, parentBalance, (wordAt(bytes, parentBalance) & ~7u) | (tag % 3 + 1)); // other valid balance
+            CHECK(loadThrows(bad));
+        }
+
+        // two live keys swapped: links and balances fine, order broken
+        vector<size_t> live;
+        for(uint64_t i = 0; i < slots && live.size() < 2; ++i) {
+            if(wordAt(bytes, header + i * slotSize + 16) != 0xFFFFFFFF) live.push_back(header + i * slotSize);
+        }
+        if(live.size() == 2) {
+            string bad = bytes;
+            setWordAt(bad, live[0], wordAt(bytes, live[1]));
+            setWordAt(bad, live[1], wordAt(bytes, live[0]));
+            CHECK(loadThrows(bad));
+        }
+    }
+
+    // 1 with right child 2, the root's balance rewritten to -1: removing 2
+    // would walk off the top of the tree
+    IndexTree two;
+    two.insert(make_pair(1, 1));
+    two.insert(make_pair(2, 2));
+    ostringstream out;
+    two.save(out);
+    string bad = out.str();
+    const size_t rootTag = 5 * sizeof(uint64_t) + 16;
+    CHECK(wordAt(bad, rootTag) == 3); // parent 0, balance +1
+    setWordAt(bad, rootTag, 1);
+    CHECK(loadThrows(bad));
+}
+
+static_assert(is_nothrow_move_constructible<SmallAVLMap<string, string> >::value,
+    "vector<SmallAVLMap> moves rather than copies on growth");
+static_assert(is_nothrow_move_assignable<SmallAVLMap<string, string> >::value,
+    "SmallAVLMap move assignment does not throw for string entries");
+
+/**
+ * A value whose copies throw while armed; moves never do.
+ */
+struct Fussy
+{
+    static bool armed;
+    int v;
+
+    Fussy(int v = 0) : v(v) { }
+    Fussy(const Fussy& other) : v(other.v) { if(armed) throw runtime_error("Fussy copy"); }
+    Fussy(Fussy&& other) noexcept : v(other.v) { }
+    Fussy& operator=(const Fussy& other) { if(armed) throw runtime_error("Fussy copy"); v = other.v; return *this; }
+    Fussy& operator=(Fussy&& other) noexcept { v = other.v; return *this; }
+    bool operator!=(const Fussy& other) const { return v != other.v; }
+};
+
+bool Fussy::armed = false;
+
+ostream& operator<<(ostream& out, const Fussy& fussy)
+{
+    return out << fussy.v;
+}
+
+/**
+ * A key that allows budget more copies and then throws; a negative budget
+ * never runs out. Moves never throw.
+ */
+struct FussyKey
+{
+    static int budget;
+    int k;
+
+    FussyKey(int k = 0) : k(k) { }
+    FussyKey(const FussyKey& other) : k(other.k) { spend(); }
+    FussyKey(FussyKey&& other) noexcept : k(other.k) { }
+    FussyKey& operator=(const FussyKey& other) { spend(); k = other.k; return *this; }
+    FussyKey& operator=(FussyKey&& other) noexcept { k = other.k; return *this; }
+    bool operator<(const FussyKey& other) const { return k < other.k; }
+    bool operator>(const FussyKey& other) const { return other.k < k; }
+    bool operator==(const FussyKey& other) const { return k == other.k; }
+    bool operator!=(const FussyKey& other) const { return k != other.k; }
+
+    static void spend()
+    {
+        if(budget == 0) throw runtime_error("FussyKey copy");
+        if(budget > 0) --budget;
+    }
+};
+
+int FussyKey::budget = -1;
+
+ostream& operator<<(ostream& out, const FussyKey& key)
+{
+    return out << key.k;
+}
+
+/**
+ * AVLTree::join whose new middle node fails to copy its value leaves both
+ * sides and the target as they were, including when the target is one of
+ * the sides.
+ */
+void checkJoinThrows()
+{
+    typedef Probe<AVLTree, int, Fussy> FussyAVL;
+    for(int target = 0; target < 3; ++target) {
+        FussyAVL tree, left, right;
+        map<int, Fussy> was, below, above;
+        for(int i = 0; i < 50; ++i) {
+            tree.insert(make_pair(i, Fussy(i)));
+            was[i] = Fussy(i);
+            left.insert(make_pair(i, Fussy(i)));
+            below[i] = Fussy(i);
+            right.insert(make_pair(i + 100, Fussy(i)));
+            above[i + 100] = Fussy(i);
+        }
+        FussyAVL& into = target == 0 ? tree : target == 1 ? left : right;
+        pair<const int, Fussy> mid(75, Fussy(75));
+        bool threw = false;
+        Fussy::armed = true;
+        try {
+            into.join(left, mid, right);
+        }
+        catch(runtime_error&) {
+            threw = true;
+        }
+        Fussy::armed = false;
+        CHECK(threw);
+        CHECK(avlHolds(tree.root()) && sameAs(tree, was));
+        CHECK(avlHolds(left.root()) && sameAs(left, below));
+        CHECK(avlHolds(right.root()) && sameAs(right, above));
+    }
+}
+
+/**
+ * SmallAVLMap against std::map across promotes and demotes, with string
+ * keys, copies and moves; and an insert whose new entry fails to copy
+ * leaving the map as it was.
+ */
+template<size_t N>
+void checkSmallMap(unsigned int seed)
+{
+    mt19937 rng(seed);
+    bool promoted = false, demoted = false;
+    for(int round = 0; round < 20; ++round) {
+        SmallAVLMap<string, int, N> small;
+        map<string, int> expected;
+        int range = 1 + static_cast<int>(rng() % (4 * N));
+        for(int step = 0; step < 400; ++step) {
+            string key = to_string(rng() % range);
+            bool wasInline = small.isInline();
+            if(rng() % 2) {
+                small.insert(make_pair(key, step));
+                expected[key] = step;
+            }
+            else {
+                small.remove(key);
+                expected.erase(key);
+            }
+            promoted |= wasInline && !small.isInline();
+            demoted |= !wasInline && small.isInline();
+            if(step % 50 == 0) {
+                SmallAVLMap<string, int, N> copy(small);
+                vector<SmallAVLMap<string, int, N> > maps(1);
+                maps[0] = std::move(copy);
+                maps.resize(8);  // grows by moving
+                CHECK(copy.empty() && sameAs(maps[0], expected));
+                small = std::move(maps[0]);
+            }
+            CHECK(small.size() == expected.size() && small.isBalanced() && sameAs(small, expected));
+            CHECK(small.isInline() ? small.size() <= N : small.size() > N / 2);
+        }
+    }
+    CHECK(promoted && demoted);
+
+    SmallAVLMap<int, Fussy, N> fussy;
+    map<int, Fussy> fussyExpected;
+    for(int i = 0; i < static_cast<int>(N); ++i) {
+        fussy.insert(make_pair(2 * i, Fussy(i)));
+        fussyExpected[2 * i] = Fussy(i);
+    }
+    for(int key = -1; key < 2 * static_cast<int>(N); key += 2) {
+        fussy.remove(2 * static_cast<int>(N) - 2);
+        fussyExpected.erase(2 * static_cast<int>(N) - 2);
+        pair<const int, Fussy> item(key, Fussy(-key));
+        Fussy::armed = true;
+        bool threw = false;
+        try {
+            fussy.insert(item);
+        }
+        catch(const runtime_error&) {
+            threw = true;
+        }
+        Fussy::armed = false;
+        CHECK(threw && fussy.size() == fussyExpected.size() && sameAs(fussy, fussyExpected));
+        fussy.insert(make_pair(2 * static_cast<int>(N) - 2, Fussy(0)));
+        fussyExpected[2 * static_cast<int>(N) - 2] = Fussy(0);
+    }
+
+    // a demote whose second key copy throws leaves the tree as it was
+    if(N >= 4) {
+        SmallAVLMap<FussyKey, string, N> keyed;
+        map<FussyKey, string> keyedExpected;
+        for(int i = 0; i <= static_cast<int>(N); ++i) {
+            keyed.insert(make_pair(FussyKey(i), string(20, static_cast<char>('a' + i))));
+            keyedExpected[FussyKey(i)] = string(20, static_cast<char>('a' + i));
+        }
+        int last = static_cast<int>(N);
+        while(keyed.size() > N / 2 + 1) {
+            keyed.remove(FussyKey(last));
+            keyedExpected.erase(FussyKey(last--));
+        }
+        CHECK(!keyed.isInline());
+        keyedExpected.erase(FussyKey(last));
+        FussyKey::budget = 1;
+        bool threw = false;
+        try {
+            keyed.remove(FussyKey(last));
+        }
+        catch(const runtime_error&) {
+            threw = true;
+        }
+        FussyKey::budget = -1;
+        CHECK(threw && !keyed.isInline() && keyed.size() == keyedExpected.size());
+        CHECK(sameAs(keyed, keyedExpected));
+    }
+}
+
+/**
+ * Random inserts, removes, eraseIf sweeps, copies and moves on a balanced
+ * tree type, mirrored on a std::map, checking the contents and holds()
+ * (the tree's own invariants) after every step.
+ */
+template<class Tree, class Holds>
+void churnAgainstMap(Holds holds, unsigned int seed)
+{
+    mt19937 rng(seed);
+    for(int round = 0; round < 20; ++round) {
+        Tree tree;
+        map<int, int> expected;
+        int range = 1 + static_cast<int>(rng() % 500);
+        for(int step = 0; step < 600; ++step) {
+            int key = static_cast<int>(rng() % range);
+            unsigned int op = rng() % 100;
+            if(op < 55) {
+                tree.insert(make_pair(key, step));
+                expected[key] = step;
+            }
+            else if(op < 95) {
+                tree.remove(key);
+                expected.erase(key);
+            }
+            else if(op < 97) {
+                int mod = 2 + static_cast<int>(rng() % 5);
+                size_t erased = tree.eraseIf([mod](const pair<const int, int>& item) { return item.first % mod == 0; });
+                size_t before = expected.size();
+                for(map<int, int>::iterator it = expected.begin(); it != expected.end(); ) {
+                    it = (it->first % mod == 0) ? expected.erase(it) : ++it;
+                }
+                CHECK(erased == before - expected.size());
+            }
+            else if(op < 99) {
+                Tree copy(tree);
+                CHECK(holds(copy.root()) && sameAs(copy, expected));
+                tree.clear();
+                tree = copy;
+            }
+            else {
+                Tree moved(std::move(tree));
+                CHECK(tree.empty());
+                tree = std::move(moved);
+            }
+            CHECK(holds(tree.root()) && sameAs(tree, expected));
+            if(failures > 20) {
+                return;
+            }
+        }
+    }
+}
+
+int main()
+{
+    checkJoinSplit();
+    checkMerge();
+    checkSplayMiss();
+    checkAugmentedAssign();
+    checkParallelThrows();
+    churnAgainstMap<Probe<RBTree, int, int> >(rbHolds<int, int>, 36);
+    churnAgainstMap<Probe<WAVLTree, int, int> >(wavlHolds<int, int>, 37);
+    checkHandles();
+    checkCompactRoundTrip();
+    checkJoinThrows();
+    checkSmallMap<1>(50);
+    checkSmallMap<4>(51);
+    checkSmallMap<16>(52);
+
+    if(failures != 0) {
+        cerr << failures << " check(s) failed" << endl;
+        return 1;
+    }
+    cout << "all checks passed" << endl;
+    return 0;
+}
@@ -0,0 +1,406 @@
+#ifndef BST_PARALLEL_H
+#define BST_PARALLEL_H
+
+#include <atomic>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "bst.h"
+
+/**
+* A unit of work for the WorkStealingPool. Tasks live on the stack of the
+* code that forks them and must be joined before they go out of scope,
+* also when the forking code throws (see WorkStealingPool::wait()). An
+* exception escaping fn is kept in error_ and rethrown by join().
+*/
+struct PoolTask
+{
+    explicit PoolTask(const std::function<void()>& fn) : fn_(fn), done_(false) { }
+
+    std::function<void()> fn_;
+    std::exception_ptr error_;
+    std::atomic<bool> done_;
+};
+
+/**
+* A small fork/join pool. Every worker owns a deque: it pushes and pops
+* its own work at the back and steals from the front of the others when
+* it runs dry. The thread that calls run() takes part as worker 0, so a
+* pool of n threads starts n - 1 extra threads.
+*
+* Waiting in join() is never idle: the waiting thread keeps running its own
+* or stolen tasks until the joined task is done, which is what keeps deep
+* recursive splits from deadlocking.
+*/
+class WorkStealingPool
+{
+public:
+    explicit WorkStealingPool(unsigned int threads = 0);
+    ~WorkStealingPool();
+
+    unsigned int size() const;
+    void run(const std::function<void()>& fn);
+    void fork(PoolTask* task);
+    void join(PoolTask* task);
+    void wait(PoolTask* task);
+
+private:
+    WorkStealingPool(const WorkStealingPool&);
+    WorkStealingPool& operator=(const WorkStealingPool&);
+
+    struct Queue
+    {
+        std::mutex lock;
+        std::deque<PoolTask*> tasks;
+    };
+
+    void workerLoop(unsigned int index);
+    bool runOne(unsigned int self);
+    static void execute(PoolTask* task);
+    static unsigned int& currentIndex();
+
+    std::vector<std::unique_ptr<Queue> > queues_;
+    std::vector<std::thread> workers_;
+    std::atomic<bool> stop_;
+};
+
+inline WorkStealingPool::WorkStealingPool(unsigned int threads) : stop_(false)
+{
+    if(threads == 0) {
+        threads = std::thread::hardware_concurrency();
+    }
+    if(threads == 0) {
+        threads = 1;
+    }
+    for(unsigned int i = 0; i < threads; ++i) {
+        queues_.push_back(std::unique_ptr<Queue>(new Queue));
+    }
+    for(unsigned int i = 1; i < threads; ++i) {
+        workers_.push_back(std::thread(&WorkStealingPool::workerLoop, this, i));
+    }
+}
+
+inline WorkStealingPool::~WorkStealingPool()
+{
+    stop_.store(true);
+    for(size_t i = 0; i < workers_.size(); ++i) {
+        workers_[i].join();
+    }
+}
+
+inline unsigned int WorkStealingPool::size() const
+{
+    return static_cast<unsigned int>(queues_.size());
+}
+
+/**
+* The index of the pool worker running on this thread.
+*/
+inline unsigned int& WorkStealingPool::currentIndex()
+{
+    static thread_local unsigned int index = 0;
+    return index;
+}
+
+/**
+* Runs fn on the calling thread as worker 0 and returns once it (and so
+* every task it joined) has finished. Exceptions from fn propagate.
+*/
+inline void WorkStealingPool::run(const std::function<void()>& fn)
+{
+    unsigned int saved = currentIndex();
+    currentIndex() = 0;
+    try {
+        fn();
+    }
+    catch(...) {
+        currentIndex() = saved;
+        throw;
+    }
+    currentIndex() = saved;
+}
+
+/**
+* Makes task available to be run by this worker later or stolen by another.
+*/
+inline void WorkStealingPool::fork(PoolTask* task)
+{
+    Queue& q = *queues_[currentIndex()];
+    std::lock_guard<std::mutex> guard(q.lock);
+    q.tasks.push_back(task);
+}
+
+/**
+* Waits for task to finish, running other tasks in the meantime, then
+* rethrows whatever the task threw.
+*/
+inline void WorkStealingPool::join(PoolTask* task)
+{
+    wait(task);
+    if(task->error_) {
+        std::rethrow_exception(task->error_);
+    }
+}
+
+/**
+* As join(), but never throws: for unwinding code that must not leave a
+* forked task behind, and already has an exception of its own in flight.
+*/
+inline void WorkStealingPool::wait(PoolTask* task)
+{
+    unsigned int self = currentIndex();
+    while(!task->done_.load(std::memory_order_acquire)) {
+        if(!runOne(self)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+* Runs task and marks it done whether or not it throws; an exception is
+* handed to whoever joins it instead of escaping on a worker thread.
+*/
+inline void WorkStealingPool::execute(PoolTask* task)
+{
+    try {
+        task->fn_();
+    }
+    catch(...) {
+        task->error_ = std::current_exception();
+    }
+    task->done_.store(true, std::memory_order_release);
+}
+
+/**
+* Runs one task, preferring the newest one on our own deque and otherwise
+* stealing the oldest one from someone else. Returns false if every deque
+* was empty.
+*/
+inline bool WorkStealingPool::runOne(unsigned int self)
+{
+    PoolTask* task = NULL;
+    {
+        Queue& own = *queues_[self];
+        std::lock_guard<std::mutex> guard(own.lock);
+        if(!own.tasks.empty()) {
+            task = own.tasks.back();
+            own.tasks.pop_back();
+        }
+    }
+    for(size_t i = 1; task == NULL && i < queues_.size(); ++i) {
+        Queue& victim = *queues_[(self + i) % queues_.size()];
+        std::lock_guard<std::mutex> guard(victim.lock);
+        if(!victim.tasks.empty()) {
+            task = victim.tasks.front();
+            victim.tasks.pop_front();
+        }
+    }
+    if(task == NULL) {
+        return false;
+    }
+    execute(task);
+    return true;
+}
+
+inline void WorkStealingPool::workerLoop(unsigned int index)
+{
+    currentIndex() = index;
+    while(!stop_.load(std::memory_order_acquire)) {
+        if(!runOne(index)) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+/**
+* Splits a BinarySearchTree (or any subclass) at subtree boundaries into
+* pool tasks. The top `cutoff` levels fork their left subtree and recurse
+* on the right one; below that a subtree is walked sequentially along the
+* successor chain, so no recursion or stack proportional to its height is
+* needed there.
+*/
+template<typename Key, typename Value>
+class ParallelTraversal
+{
+public:
+    template<typename F>
+    static void forEach(BinarySearchTree<Key, Value>& tree, F& f, unsigned int threads);
+
+    template<typename T, typename Map, typename Combine>
+    static T reduce(const BinarySearchTree<Key, Value>& tree, const T& identity,
+        Map& map, Combine& combine, unsigned int threads);
+
+private:
+    static int cutoffFor(unsigned int threads);
+    static void subtreeRange(Node<Key, Value>* top, Node<Key, Value>*& first, Node<Key, Value>*& stop);
+
+    template<typename F>
+    static void forEachNode(WorkStealingPool& pool, Node<Key, Value>* node, int depth, int cutoff, F& f);
+
+    template<typename T, typename Map, typename Combine>
+    static T reduceNode(WorkStealingPool& pool, Node<Key, Value>* node, int depth, int cutoff,
+        const T& identity, Map& map, Combine& combine);
+};
+
+/**
+* Roughly 16 tasks per thread: enough slack for stealing to even out
+* unbalanced subtrees without drowning the deques.
+*/
+template<typename Key, typename Value>
+int ParallelTraversal<Key, Value>::cutoffFor(unsigned int threads)
+{
+    int depth = 4;
+    while(threads > 1) {
+        threads /= 2;
+        ++depth;
+    }
+    return depth;
+}
+
+/**
+* The first node of the subtree rooted at top and the node just past its
+* last one, so the subtree can be walked along the successor chain.
+*/
+template<typename Key, typename Value>
+void ParallelTraversal<Key, Value>::subtreeRange(Node<Key, Value>* top, Node<Key, Value>*& first, Node<Key, Value>*& stop)
+{
+    first = top;
+    while(first->getLeft() != NULL) {
+        first = first->getLeft();
+    }
+    Node<Key, Value>* last = top;
+    while(last->getRight() != NULL) {
+        last = last->getRight();
+    }
+    stop = last->getNext();
+}
+
+template<typename Key, typename Value>
+template<typename F>
+void ParallelTraversal<Key, Value>::forEachNode(WorkStealingPool& pool, Node<Key, Value>* node,
+    int depth, int cutoff, F& f)
+{
+    if(node == NULL) {
+        return;
+    }
+    if(depth >= cutoff) {
+        Node<Key, Value>* curr;
+        Node<Key, Value>* stop;
+        subtreeRange(node, curr, stop);
+        for(; curr != stop; curr = curr->getNext()) {
+            f(curr->getItem());
+        }
+        return;
+    }
+
+    Node<Key, Value>* left = node->getLeft();
+    PoolTask task([&pool, left, depth, cutoff, &f]() {
+        forEachNode(pool, left, depth + 1, cutoff, f);
+    });
+    pool.fork(&task);
+    try {
+        f(node->getItem());
+        forEachNode(pool, node->getRight(), depth + 1, cutoff, f);
+    }
+    catch(...) {
+        pool.wait(&task); // task refers to this frame
+        throw;
+    }
+    pool.join(&task);
+}
+
+template<typename Key, typename Value>
+template<typename T, typename Map, typename Combine>
+T ParallelTraversal<Key, Value>::reduceNode(WorkStealingPool& pool, Node<Key, Value>* node,
+    int depth, int cutoff, const T& identity, Map& map, Combine& combine)
+{
+    if(node == NULL) {
+        return identity;
+    }
+    if(depth >= cutoff) {
+        Node<Key, Value>* curr;
+        Node<Key, Value>* stop;
+        subtreeRange(node, curr, stop);
+        T acc = identity;
+        for(; curr != stop; curr = curr->getNext()) {
+            acc = combine(acc, map(curr->getItem()));
+        }
+        return acc;
+    }
+
+    Node<Key, Value>* left = node->getLeft();
+    T leftResult = identity;
+    PoolTask task([&pool, left, depth, cutoff, &identity, &map, &combine, &leftResult]() {
+        leftResult = reduceNode(pool, left, depth + 1, cutoff, identity, map, combine);
+    });
+    pool.fork(&task);
+    T mid = identity;
+    T rightResult = identity;
+    try {
+        mid = map(node->getItem());
+        rightResult = reduceNode(pool, node->getRight(), depth + 1, cutoff, identity, map, combine);
+    }
+    catch(...) {
+        pool.wait(&task); // task refers to this frame
+        throw;
+    }
+    pool.join(&task);
+    // combine strictly left to right so non-commutative reductions see in-order data
+    return combine(combine(leftResult, mid), rightResult);
+}
+
+template<typename Key, typename Value>
+template<typename F>
+void ParallelTraversal<Key, Value>::forEach(BinarySearchTree<Key, Value>& tree, F& f, unsigned int threads)
+{
+    WorkStealingPool pool(threads);
+    int cutoff = cutoffFor(pool.size());
+    Node<Key, Value>* root = tree.root_;
+    pool.run([&]() { forEachNode(pool, root, 0, cutoff, f); });
+}
+
+template<typename Key, typename Value>
+template<typename T, typename Map, typename Combine>
+T ParallelTraversal<Key, Value>::reduce(const BinarySearchTree<Key, Value>& tree, const T& identity,
+    Map& map, Combine& combine, unsigned int threads)
+{
+    WorkStealingPool pool(threads);
+    int cutoff = cutoffFor(pool.size());
+    Node<Key, Value>* root = tree.root_;
+    T result = identity;
+    pool.run([&]() { result = reduceNode(pool, root, 0, cutoff, identity, map, combine); });
+    return result;
+}
+
+/**
+* Calls f(std::pair<const Key, Value>&) once for every entry, from up to
+* `threads` threads at once (0 means one per core). The order of calls is
+* unspecified and f must be safe to call concurrently. The tree must not
+* be modified structurally while this runs. If f throws, one of the
+* exceptions is rethrown here once every task already started is done.
+*/
+template<typename Key, typename Value, typename F>
+void parallelForEach(BinarySearchTree<Key, Value>& tree, F f, unsigned int threads = 0)
+{
+    ParallelTraversal<Key, Value>::forEach(tree, f, threads);
+}
+
+/**
+* Maps every entry with map(const std::pair<const Key, Value>&) and folds
+* the results with combine, in parallel. combine must be associative with
+* identity as its identity element; it does not have to be commutative,
+* since partial results are always combined in key order. Exceptions from
+* map or combine are rethrown as for parallelForEach().
+*/
+template<typename Key, typename Value, typename T, typename Map, typename Combine>
+T parallelReduce(const BinarySearchTree<Key, Value>& tree, T identity, Map map, Combine combine,
+    unsigned int threads = 0)
+{
+    return ParallelTraversal<Key, Value>::reduce(tree, identity, map, combine, threads);
+}
+
+#endif
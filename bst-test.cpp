@@ -2,6 +2,7 @@
 #include <map>
 #include "bst.h"
 #include "avlbst.h"
+#include "bstset.h"
 
 using namespace std;
 
@@ -44,5 +45,53 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
+    // Bulk build and merge
+    std::vector<std::pair<char,int> > items;
+    items.push_back(std::make_pair('c',3));
+    items.push_back(std::make_pair('a',1));
+    items.push_back(std::make_pair('b',2));
+    AVLTree<char,int> built;
+    built.build(items);
+    AVLTree<char,int> other;
+    other.insert(std::make_pair('d',4));
+    other.insert(std::make_pair('a',10));
+    built.merge(std::move(other));
+
+    cout << "\nMerged AVLTree contents:" << endl;
+    for(AVLTree<char,int>::iterator it = built.begin(); it != built.end(); ++it) {
+        cout << it->first << " " << it->second << endl;
+    }
+
+    // Shape statistics: sorted inserts degrade a plain BST into a chain
+    BinarySearchTree<int,int> sorted;
+    AVLTree<int,int> balanced;
+    for(int i = 0; i < 1000; ++i) {
+        sorted.insert(std::make_pair(i, i));
+        balanced.insert(std::make_pair(i, i));
+    }
+    ShapeStats chain = sorted.shapeStats();
+    ShapeStats avl = balanced.shapeStats();
+    cout << "\nShape after 1000 sorted inserts:" << endl;
+    cout << "BinarySearchTree height " << chain.height() << ", unary nodes " << chain.unaryNodes
+         << ", average depth " << chain.averageNodeDepth() << endl;
+    cout << "AVLTree height " << avl.height() << ", unary nodes " << avl.unaryNodes
+         << ", average depth " << avl.averageNodeDepth() << ", fullness " << avl.fullness() << endl;
+
+    // Key-only sets and set algebra
+    AVLSet<int> odds, small;
+    for(int i = 1; i < 10; i += 2) {
+        odds.insert(i);
+    }
+    for(int i = 0; i < 5; ++i) {
+        small.insert(i);
+    }
+    AVLSet<int> both;
+    both.setIntersection(odds, small);
+    cout << "\nOdd keys below 5:";
+    for(AVLSet<int>::iterator it = both.begin(); it != both.end(); ++it) {
+        cout << " " << it->first;
+    }
+    cout << endl;
+
     return 0;
 }
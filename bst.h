@@ -4,7 +4,55 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <memory>
 #include <utility>
+#include <vector>
+#include "shape-stats.h"
+
+/**
+ * The Value of a tree used as a set (BSTSet, AVLSet). Nodes of such a tree
+ * store a SetItem, which holds nothing but the key.
+ */
+struct NoValue
+{
+};
+
+inline bool operator==(const NoValue&, const NoValue&) { return true; }
+inline bool operator!=(const NoValue&, const NoValue&) { return false; }
+inline std::ostream& operator<<(std::ostream& out, const NoValue&) { return out << '-'; }
+
+/**
+ * Stands in for std::pair<const Key, NoValue>: first is the key and second
+ * is a shared NoValue, so it->first and it->second still work but a node
+ * spends no space on the value.
+ */
+template <typename Key>
+struct SetItem
+{
+    SetItem(const Key& key, const NoValue&) : first(key) { }
+    operator const Key&() const { return first; }
+
+    const Key first;
+    static NoValue second;
+};
+
+template <typename Key>
+NoValue SetItem<Key>::second;
+
+/**
+ * What a Node<Key, Value> stores and an iterator points at.
+ */
+template <typename Key, typename Value>
+struct NodeItem
+{
+    typedef std::pair<const Key, Value> type;
+};
+
+template <typename Key>
+struct NodeItem<Key, NoValue>
+{
+    typedef SetItem<Key> type;
+};
 
 /**
  * A templated class for a Node in a search tree.
@@ -17,11 +65,13 @@ template <typename Key, typename Value>
 class Node
 {
 public:
+    typedef typename NodeItem<Key, Value>::type Item;
+
     Node(const Key& key, const Value& value, Node<Key, Value>* parent);
     virtual ~Node();
 
-    const std::pair<const Key, Value>& getItem() const;
-    std::pair<const Key, Value>& getItem();
+    const Item& getItem() const;
+    Item& getItem();
     const Key& getKey() const;
     const Value& getValue() const;
     Value& getValue();
@@ -29,17 +79,20 @@ public:
     virtual Node<Key, Value>* getParent() const;
     virtual Node<Key, Value>* getLeft() const;
     virtual Node<Key, Value>* getRight() const;
+    Node<Key, Value>* getNext() const;
 
     void setParent(Node<Key, Value>* parent);
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
+    void setNext(Node<Key, Value>* next);
     void setValue(const Value &value);
 
 protected:
-    std::pair<const Key, Value> item_;
+    Item item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
+    Node<Key, Value>* next_;    // in-order successor, maintained by the tree
 };
 
 /*
@@ -56,7 +109,8 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
     item_(key, value),
     parent_(parent),
     left_(NULL),
-    right_(NULL)
+    right_(NULL),
+    next_(NULL)
 {
 
 }
@@ -76,7 +130,7 @@ Node<Key, Value>::~Node()
 * A const getter for the item.
 */
 template<typename Key, typename Value>
-const std::pair<const Key, Value>& Node<Key, Value>::getItem() const
+const typename Node<Key, Value>::Item& Node<Key, Value>::getItem() const
 {
     return item_;
 }
@@ -85,7 +139,7 @@ const std::pair<const Key, Value>& Node<Key, Value>::getItem() const
 * A non-const getter for the item.
 */
 template<typename Key, typename Value>
-std::pair<const Key, Value>& Node<Key, Value>::getItem()
+typename Node<Key, Value>::Item& Node<Key, Value>::getItem()
 {
     return item_;
 }
@@ -144,6 +198,16 @@ Node<Key, Value>* Node<Key, Value>::getRight() const
     return right_;
 }
 
+/**
+* A getter for the in-order successor. Unlike the structural getters this is
+* not virtual: it is the one load the iterator does per step.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* Node<Key, Value>::getNext() const
+{
+    return next_;
+}
+
 /**
 * A setter for setting the parent of a node.
 */
@@ -171,6 +235,15 @@ void Node<Key, Value>::setRight(Node<Key, Value>* right)
     right_ = right;
 }
 
+/**
+* A setter for the in-order successor of a node.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setNext(Node<Key, Value>* next)
+{
+    next_ = next;
+}
+
 /**
 * A setter for the value of a node.
 */
@@ -186,6 +259,120 @@ void Node<Key, Value>::setValue(const Value& value)
   ---------------------------------------
 */
 
+/**
+* Owns one node taken out of a tree by extract(), until insert() links it
+* into another tree of the same class or the handle goes away. Moving an
+* entry this way allocates and copies nothing. Move-only.
+*
+* Tree is the class that made the handle: each tree takes only its own
+* node_type, so handing a node to a tree that lays its nodes out
+* differently does not compile.
+*/
+template <typename Key, typename Value, typename Tree>
+class NodeHandle
+{
+public:
+    typedef void (*Dispose)(Node<Key, Value>* node, void* storage);
+
+    NodeHandle();
+    NodeHandle(NodeHandle<Key, Value, Tree>&& other) noexcept;
+    NodeHandle<Key, Value, Tree>& operator=(NodeHandle<Key, Value, Tree>&& other) noexcept;
+    ~NodeHandle();
+
+    NodeHandle(const NodeHandle<Key, Value, Tree>&) = delete;
+    NodeHandle<Key, Value, Tree>& operator=(const NodeHandle<Key, Value, Tree>&) = delete;
+
+    bool empty() const;
+    explicit operator bool() const;
+    const Key& key() const;
+    Value& value() const;
+
+protected:
+    template<typename TKey, typename TValue>
+    friend class BinarySearchTree;
+
+    NodeHandle(Node<Key, Value>* node, const std::shared_ptr<void>& storage, Dispose dispose);
+    void reset();
+
+    Node<Key, Value>* node_;
+    std::shared_ptr<void> storage_; // what the node lives in if it did not come from new
+    Dispose dispose_;
+};
+
+template<typename Key, typename Value, typename Tree>
+NodeHandle<Key, Value, Tree>::NodeHandle() : node_(NULL), dispose_(NULL)
+{
+}
+
+template<typename Key, typename Value, typename Tree>
+NodeHandle<Key, Value, Tree>::NodeHandle(Node<Key, Value>* node, const std::shared_ptr<void>& storage, Dispose dispose) :
+    node_(node), storage_(storage), dispose_(dispose)
+{
+}
+
+template<typename Key, typename Value, typename Tree>
+NodeHandle<Key, Value, Tree>::NodeHandle(NodeHandle<Key, Value, Tree>&& other) noexcept :
+    node_(other.node_), storage_(std::move(other.storage_)), dispose_(other.dispose_)
+{
+    other.node_ = NULL;
+}
+
+template<typename Key, typename Value, typename Tree>
+NodeHandle<Key, Value, Tree>& NodeHandle<Key, Value, Tree>::operator=(NodeHandle<Key, Value, Tree>&& other) noexcept
+{
+    if(this != &other) {
+        reset();
+        node_ = other.node_;
+        storage_ = std::move(other.storage_);
+        dispose_ = other.dispose_;
+        other.node_ = NULL;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Tree>
+NodeHandle<Key, Value, Tree>::~NodeHandle()
+{
+    reset();
+}
+
+/**
+* Frees the node, if any, the same way the tree it came from would have.
+*/
+template<typename Key, typename Value, typename Tree>
+void NodeHandle<Key, Value, Tree>::reset()
+{
+    if(node_ != NULL) {
+        dispose_(node_, storage_.get());
+        node_ = NULL;
+    }
+    storage_.reset();
+}
+
+template<typename Key, typename Value, typename Tree>
+bool NodeHandle<Key, Value, Tree>::empty() const
+{
+    return node_ == NULL;
+}
+
+template<typename Key, typename Value, typename Tree>
+NodeHandle<Key, Value, Tree>::operator bool() const
+{
+    return node_ != NULL;
+}
+
+template<typename Key, typename Value, typename Tree>
+const Key& NodeHandle<Key, Value, Tree>::key() const
+{
+    return node_->getKey();
+}
+
+template<typename Key, typename Value, typename Tree>
+Value& NodeHandle<Key, Value, Tree>::value() const
+{
+    return node_->getValue();
+}
+
 /**
 * A templated unbalanced binary search tree.
 */
@@ -194,16 +381,24 @@ class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    BinarySearchTree(const BinarySearchTree<Key, Value>& other);
+    BinarySearchTree(BinarySearchTree<Key, Value>&& other) noexcept;
+    BinarySearchTree<Key, Value>& operator=(const BinarySearchTree<Key, Value>& other);
+    BinarySearchTree<Key, Value>& operator=(BinarySearchTree<Key, Value>&& other) noexcept;
     virtual ~BinarySearchTree(); //TODO
+    void swap(BinarySearchTree<Key, Value>& other) noexcept;
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
-    void clear(); //TODO
+    virtual void clear(); //TODO
     bool isBalanced() const; //TODO
+    ShapeStats shapeStats() const;
     void print() const;
     bool empty() const;
 
     template<typename PPKey, typename PPValue>
     friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    template<typename PKey, typename PValue>
+    friend class ParallelTraversal;
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -213,8 +408,8 @@ public:
     public:
         iterator();
 
-        std::pair<const Key,Value>& operator*() const;
-        std::pair<const Key,Value>* operator->() const;
+        typename Node<Key, Value>::Item& operator*() const;
+        typename Node<Key, Value>::Item* operator->() const;
 
         bool operator==(const iterator& rhs) const;
         bool operator!=(const iterator& rhs) const;
@@ -231,12 +426,21 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    void findMany(const Key* keys, size_t count, iterator* out) const;
+    iterator erase(iterator pos);
+    template<typename Pred>
+    size_t eraseIf(Pred pred);
+    typedef NodeHandle<Key, Value, BinarySearchTree<Key, Value> > node_type;
+    node_type extract(const Key& key);
+    node_type extract(iterator pos);
+    iterator insert(node_type&& handle);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
+    Node<Key, Value>* internalFind(const Key& k, Node<Key, Value>*& last) const;
     Node<Key, Value> *getSmallestNode() const;  // TODO
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     // Note:  static means these functions don't have a "this" pointer
@@ -248,8 +452,33 @@ protected:
 
     // Add helper functions here
     void eraseFunc(Node<Key, Value> * node); // delete helper 
+    virtual void destroyNode(Node<Key, Value>* node); // frees one node; subclasses may not own every node through new
+    Node<Key, Value>* removeNode(Node<Key, Value>* node); // unlink and free, returns where to rebalance from
+    virtual void eraseNode(Node<Key, Value>* node); // remove() once the node is found: detachNode() + destroyNode()
+    virtual void detachNode(Node<Key, Value>* node); // unhook and rebalance, leaving node alive; trees override it
+    typedef void (*NodeDispose)(Node<Key, Value>* node, void* storage);
+    template<typename Handle>
+    Handle extractKey(const Key& key); // extract() for every tree's node_type
+    template<typename Handle>
+    Handle extractAt(iterator pos);
+    template<typename Handle>
+    iterator insertHandle(Handle&& handle);
+    virtual NodeDispose releaseNode(Node<Key, Value>* node, std::shared_ptr<void>& storage); // how a handle frees a node detachNode() let go of
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage, NodeDispose dispose); // insert() of a handle
+    Node<Key, Value>* placeLeaf(Node<Key, Value>* node); // hang a detached node where its key belongs
+    static void deleteNode(Node<Key, Value>* node, void* storage); // NodeHandle disposal for nodes from new
+    virtual void eraseNodes(const std::vector<Node<Key, Value>*>& doomed, size_t total); // eraseIf() victims, in key order
+    template<typename NodeT>
+    void cloneFrom(const BinarySearchTree<Key, Value>& other); // copy other's shape into this empty tree
+    Node<Key, Value>* spliceOut(Node<Key, Value>* node, bool& leftShrank); // unhook without moving any other node
+    Node<Key, Value>* rotateLeft(Node<Key, Value>* x); // x's right child takes x's place
+    Node<Key, Value>* rotateRight(Node<Key, Value>* y); // y's left child takes y's place
+    static iterator iteratorAt(Node<Key, Value>* node) { return iterator(node); }
+    static Node<Key, Value>* nodeAt(const iterator& it) { return it.current_; }
     int checkBalance(Node<Key, Value>* n) const; // balance helper
     Node<Key, Value>* getSmallestNodeRecursive(Node<Key, Value>* node) const; // smallest node 
+    static void linkInOrder(Node<Key, Value>* node); // thread a new leaf into the successor chain
+    static void unlinkInOrder(Node<Key, Value>* node); // drop a node from the successor chain
    
 
 
@@ -290,7 +519,7 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 * Provides access to the item.
 */
 template<class Key, class Value>
-std::pair<const Key,Value> &
+typename Node<Key, Value>::Item &
 BinarySearchTree<Key, Value>::iterator::operator*() const
 {
   return current_->getItem();
@@ -300,7 +529,7 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 * Provides access to the address of the item.
 */
 template<class Key, class Value>
-std::pair<const Key,Value> *
+typename Node<Key, Value>::Item *
 BinarySearchTree<Key, Value>::iterator::operator->() const
 {
     return &(current_->getItem());
@@ -308,21 +537,15 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 
 /**
 * Checks if 'this' iterator's internals have the same value
-* as 'rhs'
+* as 'rhs'. Keys are unique within a tree, so two iterators over
+* the same tree refer to the same item exactly when they hold the
+* same node; Value needs no operator==.
 */
 template<class Key, class Value>
 bool
 BinarySearchTree<Key, Value>::iterator::operator==(const BinarySearchTree<Key, Value>::iterator& rhs) const {
   // TODO
-  if (rhs.current_ == nullptr) {
-    return current_ == nullptr;
-  }
-  if ((current_->getValue() == rhs->second) && (current_->getKey() == rhs->first)) {
-    return true;
-  } 
-  else {
-    return false;
-  }
+  return current_ == rhs.current_;
 }
 
 /**
@@ -335,45 +558,21 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
     const BinarySearchTree<Key, Value>::iterator& rhs) const
 {
     // TODO
-  if (!rhs.current_) {
-    return current_ != nullptr;
-  }
-
-  return current_->getValue() != rhs->second || current_->getKey() != rhs->first;
+  return current_ != rhs.current_;
 }
 
 
 /**
-* Advances the iterator's location using an in-order sequencing
+* Advances the iterator's location using an in-order sequencing.
+* O(1) worst case.
 */
 template<class Key, class Value>
 typename BinarySearchTree<Key, Value>::iterator&
 BinarySearchTree<Key, Value>::iterator::operator++()
 {
-    // TODO
-  if (current_->getRight() != nullptr) {
-      current_ = current_->getRight();
-
-      while (current_->getLeft() != nullptr) {
-        current_ = current_->getLeft();
-      }
-
-      return *this;
-  } 
-
-  else { // Case in which the right branch doesn't exist
-    Node<Key, Value>* parent = current_->getParent();
-    while (parent != nullptr) {
-      if (current_ == parent->getLeft()) {
-        current_ = parent;
-        return *this;
-      }
-      current_ = parent;
-      parent = current_->getParent();
-    }
-  }
-  // If not done, then there was no successor
-  current_ = nullptr;
+  // Every tree keeps next_ pointing at the in-order successor, so advancing
+  // is a single load instead of a climb through getParent().
+  current_ = current_->getNext();
   return *this;
 }
 
@@ -401,6 +600,49 @@ BinarySearchTree<Key, Value>::BinarySearchTree()
 
 }
 
+/**
+* Copies other node for node, keeping its shape, in O(n). Trees derived
+* from this one define their own copy constructors so that the copies get
+* their node type and balance data.
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(const BinarySearchTree<Key, Value>& other)
+{
+    root_ = NULL;
+    cloneFrom<Node<Key, Value> >(other);
+}
+
+/**
+* Takes other's nodes, leaving it empty. O(1).
+*/
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>::BinarySearchTree(BinarySearchTree<Key, Value>&& other) noexcept
+{
+    root_ = other.root_;
+    other.root_ = NULL;
+}
+
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(const BinarySearchTree<Key, Value>& other)
+{
+    if(this != &other) {
+        clear();
+        cloneFrom<Node<Key, Value> >(other);
+    }
+    return *this;
+}
+
+template<typename Key, typename Value>
+BinarySearchTree<Key, Value>& BinarySearchTree<Key, Value>::operator=(BinarySearchTree<Key, Value>&& other) noexcept
+{
+    if(this != &other) {
+        clear();
+        root_ = other.root_;
+        other.root_ = NULL;
+    }
+    return *this;
+}
+
 template<typename Key, typename Value>
 BinarySearchTree<Key, Value>::~BinarySearchTree()
 {
@@ -408,6 +650,15 @@ BinarySearchTree<Key, Value>::~BinarySearchTree()
 
 }
 
+/**
+* Exchanges the contents of two trees in O(1).
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::swap(BinarySearchTree<Key, Value>& other) noexcept
+{
+    std::swap(root_, other.root_);
+}
+
 /**
  * Returns true if tree is empty
 */
@@ -458,6 +709,54 @@ BinarySearchTree<Key, Value>::find(const Key & k) const
     return it;
 }
 
+/**
+* Looks up count keys at once, storing find(keys[i]) in out[i]. Searches
+* advance in groups of FIND_GROUP, one level per round, and each search
+* prefetches its next node before any of them is touched again, so the
+* cache misses of the group overlap instead of following one another.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::findMany(const Key* keys, size_t count, iterator* out) const
+{
+    const size_t FIND_GROUP = 8;
+    Node<Key, Value>* cursor[FIND_GROUP];
+    for(size_t base = 0; base < count; base += FIND_GROUP) {
+        size_t width = count - base < FIND_GROUP ? count - base : FIND_GROUP;
+        for(size_t i = 0; i < width; ++i) {
+            cursor[i] = root_;
+            out[base + i] = end();
+        }
+        bool active = root_ != NULL;
+        while(active) {
+            active = false;
+            for(size_t i = 0; i < width; ++i) {
+                Node<Key, Value>* curr = cursor[i];
+                if(curr == NULL) {
+                    continue;
+                }
+                const Key& key = keys[base + i];
+                if(curr->getKey() == key) {
+                    out[base + i] = iterator(curr);
+                    curr = NULL;
+                }
+                else if(key < curr->getKey()) {
+                    curr = curr->getLeft();
+                }
+                else {
+                    curr = curr->getRight();
+                }
+                if(curr != NULL) {
+#if defined(__GNUC__)
+                    __builtin_prefetch(curr);
+#endif
+                    active = true;
+                }
+                cursor[i] = curr;
+            }
+        }
+    }
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
@@ -513,12 +812,14 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
     }
 
     // At this point, currentNode is nullptr and parent points to the future parent of the new node
+    Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent);
     if (isLeftChild) {
-      parent->setLeft(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent));
+      parent->setLeft(newNode);
     } 
     else {
-      parent->setRight(new Node<Key, Value>(keyValuePair.first, keyValuePair.second, parent));
+      parent->setRight(newNode);
     }
+    linkInOrder(newNode);
 }
 
 
@@ -533,38 +834,341 @@ void BinarySearchTree<Key, Value>::remove(const Key& key) {
   if (nodeToRemove == nullptr) {
     return; // not found.
   }
+  eraseNode(nodeToRemove);
+}
+
+/**
+* Removes the item pos refers to and returns an iterator to the next one,
+* without searching for the key again. Removing a node never moves any
+* other node (see spliceOut()), so the successor read beforehand is still
+* the right answer afterwards, and iterators to other items stay valid.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::erase(iterator pos) {
+  Node<Key, Value>* next = pos.current_->getNext();
+  eraseNode(pos.current_);
+  return iterator(next);
+}
 
-  // has two children.
-  if (nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr) {
-    Node<Key, Value>* predecessorNode = predecessor(nodeToRemove);
-    nodeSwap(predecessorNode, nodeToRemove);
+/**
+* Removes every item for which pred(item) is true and returns how many
+* went. pred sees each item exactly once, in key order, in a single sweep
+* along the successor chain; the victims are then handed to eraseNodes()
+* together, so a balanced tree can pick the cheaper way to repair itself.
+*/
+template<typename Key, typename Value>
+template<typename Pred>
+size_t BinarySearchTree<Key, Value>::eraseIf(Pred pred) {
+  std::vector<Node<Key, Value>*> doomed;
+  size_t total = 0;
+  for (Node<Key, Value>* node = getSmallestNode(); node != nullptr; node = node->getNext()) {
+    if (pred(node->getItem())) {
+      doomed.push_back(node);
+    }
+    ++total;
+  }
+  if (!doomed.empty()) {
+    eraseNodes(doomed, total);
   }
+  return doomed.size();
+}
 
-  // nodeToRemove will have at most one child.
-  Node<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? nodeToRemove->getLeft() : nodeToRemove->getRight();
-  
-  // nodeToRemove is not the root.
-  if (nodeToRemove != root_) {
-    if (nodeToRemove == nodeToRemove->getParent()->getLeft()) {
-      nodeToRemove->getParent()->setLeft(child);
-    } 
+/**
+* Removes node, which is in this tree, and frees it.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseNode(Node<Key, Value>* node) {
+  detachNode(node);
+  destroyNode(node);
+}
+
+/**
+* Takes node out of the tree without freeing it. A plain BST just splices
+* it out; balanced trees also repair their invariants here.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::detachNode(Node<Key, Value>* node) {
+  unlinkInOrder(node);
+  bool leftShrank;
+  spliceOut(node, leftShrank);
+}
+
+/**
+* Detaches the entry with the given key and hands over its node; the
+* handle is empty if the key is absent.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::node_type BinarySearchTree<Key, Value>::extract(const Key& key) {
+  return extractKey<node_type>(key);
+}
+
+/**
+* Detaches the entry pos refers to, without searching for it again.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::node_type BinarySearchTree<Key, Value>::extract(iterator pos) {
+  return extractAt<node_type>(pos);
+}
+
+/**
+* Links the node held by handle into this tree, and rebalances as
+* insert() would. If the key is already present nothing changes and the
+* handle keeps its node. Returns an iterator to the entry with that key
+* either way.
+*/
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insert(node_type&& handle) {
+  return insertHandle(std::move(handle));
+}
+
+/**
+* The bodies of extract() and insert(). Subclasses instantiate them with
+* their own node_type, which is what keeps a node out of a tree of another
+* class.
+*/
+template<typename Key, typename Value>
+template<typename Handle>
+Handle BinarySearchTree<Key, Value>::extractKey(const Key& key) {
+  Node<Key, Value>* node = internalFind(key);
+  if (node == nullptr) {
+    return Handle();
+  }
+  return extractAt<Handle>(iterator(node));
+}
+
+template<typename Key, typename Value>
+template<typename Handle>
+Handle BinarySearchTree<Key, Value>::extractAt(iterator pos) {
+  Node<Key, Value>* node = pos.current_;
+  detachNode(node);
+  std::shared_ptr<void> storage;
+  NodeDispose dispose = releaseNode(node, storage);
+  return Handle(node, storage, dispose);
+}
+
+template<typename Key, typename Value>
+template<typename Handle>
+typename BinarySearchTree<Key, Value>::iterator
+BinarySearchTree<Key, Value>::insertHandle(Handle&& handle) {
+  if (handle.node_ == nullptr) {
+    return end();
+  }
+  Node<Key, Value>* at = attachNode(handle.node_, handle.storage_, handle.dispose_);
+  if (at == handle.node_) {
+    handle.node_ = nullptr;
+    handle.storage_.reset();
+  }
+  return iterator(at);
+}
+
+template<typename Key, typename Value>
+typename BinarySearchTree<Key, Value>::NodeDispose
+BinarySearchTree<Key, Value>::releaseNode(Node<Key, Value>* node, std::shared_ptr<void>& storage) {
+  (void)node;
+  storage.reset();
+  return &BinarySearchTree<Key, Value>::deleteNode;
+}
+
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::deleteNode(Node<Key, Value>* node, void* storage) {
+  (void)storage;
+  delete node;
+}
+
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage, NodeDispose dispose) {
+  (void)storage;
+  (void)dispose;
+  return placeLeaf(node);
+}
+
+/**
+* Hangs node, left over from another tree, as a leaf where its key
+* belongs and threads it into the successor chain. Returns node, or the
+* node that already holds the key, in which case nothing changes.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::placeLeaf(Node<Key, Value>* node) {
+  const Key& key = node->getKey();
+  Node<Key, Value>* parent = nullptr;
+  Node<Key, Value>* curr = root_;
+  while (curr != nullptr) {
+    if (key < curr->getKey()) {
+      parent = curr;
+      curr = curr->getLeft();
+    }
+    else if (curr->getKey() < key) {
+      parent = curr;
+      curr = curr->getRight();
+    }
     else {
-      nodeToRemove->getParent()->setRight(child);
+      return curr;
     }
+  }
+
+  node->setParent(parent);
+  node->setLeft(nullptr);
+  node->setRight(nullptr);
+  node->setNext(nullptr);
+  if (parent == nullptr) {
+    root_ = node;
+  }
+  else if (key < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  linkInOrder(node);
+  return node;
+}
+
+/**
+* Removes the nodes in doomed (in key order) from a tree of total nodes.
+* By default one eraseNode() each.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::eraseNodes(const std::vector<Node<Key, Value>*>& doomed, size_t total) {
+  (void)total;
+  for (size_t i = 0; i < doomed.size(); ++i) {
+    eraseNode(doomed[i]);
+  }
+}
+
+/**
+* Takes nodeToRemove out of the tree and frees it. Returns the lowest node
+* whose subtree changed (see spliceOut()), or NULL; that is where any
+* rebalancing or splaying has to start.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::removeNode(Node<Key, Value>* nodeToRemove) {
+  unlinkInOrder(nodeToRemove);
+  bool leftShrank;
+  Node<Key, Value>* parent = spliceOut(nodeToRemove, leftShrank);
+  destroyNode(nodeToRemove);
+  return parent;
+}
 
-    if (child != nullptr) {
-      child->setParent(nodeToRemove->getParent());
+/**
+* Unhooks node from the tree. A node with two children is replaced by its
+* predecessor, which is relinked straight into node's place: no other
+* node moves and no payload is touched, so iterators to every other entry
+* stay valid, for a handful of pointer writes instead of a full nodeSwap.
+*
+* Returns the node whose left (leftShrank) or right subtree lost node's
+* slot, or NULL if that was the root's position. When a predecessor was
+* moved up, subclasses copy node's balance data onto it.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::spliceOut(Node<Key, Value>* node, bool& leftShrank) {
+  Node<Key, Value>* parent = node->getParent();
+  Node<Key, Value>* replacement;
+  Node<Key, Value>* changed;
+
+  if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+    replacement = node->getLeft();
+    while (replacement->getRight() != nullptr) {
+      replacement = replacement->getRight();
     }
-  } 
-  
-  else { 
-    root_ = child;
-    if (child != nullptr) {
-      child->setParent(nullptr);
+    if (replacement == node->getLeft()) {
+      changed = replacement;
+      leftShrank = true;
+    }
+    else {
+      // lift the predecessor out of its spot first; it has no right child
+      changed = replacement->getParent();
+      leftShrank = false;
+      changed->setRight(replacement->getLeft());
+      if (replacement->getLeft() != nullptr) {
+        replacement->getLeft()->setParent(changed);
+      }
+      replacement->setLeft(node->getLeft());
+      node->getLeft()->setParent(replacement);
     }
+    replacement->setRight(node->getRight());
+    node->getRight()->setParent(replacement);
+  }
+  else {
+    replacement = (node->getLeft() != nullptr) ? node->getLeft() : node->getRight();
+    changed = parent;
+    leftShrank = (parent != nullptr && node == parent->getLeft());
   }
 
-  delete nodeToRemove;
+  if (replacement != nullptr) {
+    replacement->setParent(parent);
+  }
+  if (parent == nullptr) {
+    root_ = replacement;
+  }
+  else if (node == parent->getLeft()) {
+    parent->setLeft(replacement);
+  }
+  else {
+    parent->setRight(replacement);
+  }
+  return changed;
+}
+
+/**
+* Rotates x's right child up into x's place and returns it. Only the
+* links change; root_ follows if x was the root. Subtrees detached from
+* the tree (parent NULL but not root_) can be rotated too.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::rotateLeft(Node<Key, Value>* x) {
+  Node<Key, Value>* y = x->getRight();
+  x->setRight(y->getLeft());
+  if (y->getLeft() != nullptr) {
+    y->getLeft()->setParent(x);
+  }
+
+  y->setParent(x->getParent());
+  if (x->getParent() == nullptr) {
+    if (root_ == x) {
+      root_ = y;
+    }
+  }
+  else if (x == x->getParent()->getLeft()) {
+    x->getParent()->setLeft(y);
+  }
+  else {
+    x->getParent()->setRight(y);
+  }
+
+  y->setLeft(x);
+  x->setParent(y);
+  return y;
+}
+
+/**
+* Mirror image of rotateLeft(): y's left child takes y's place.
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::rotateRight(Node<Key, Value>* y) {
+  Node<Key, Value>* x = y->getLeft();
+  y->setLeft(x->getRight());
+  if (x->getRight() != nullptr) {
+    x->getRight()->setParent(y);
+  }
+
+  x->setParent(y->getParent());
+  if (y->getParent() == nullptr) {
+    if (root_ == y) {
+      root_ = x;
+    }
+  }
+  else if (y == y->getParent()->getLeft()) {
+    y->getParent()->setLeft(x);
+  }
+  else {
+    y->getParent()->setRight(x);
+  }
+
+  x->setRight(y);
+  y->setParent(x);
+  return x;
 }
 
 
@@ -597,6 +1201,72 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
 
 
 
+/**
+* Splices a freshly attached leaf into the successor chain. A right child's
+* predecessor is its parent; a left child's is found by a short climb over
+* nodes the insert just walked past.
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::linkInOrder(Node<Key, Value>* node)
+{
+  Node<Key, Value>* pred = predecessor(node);
+  if (pred != nullptr) {
+    node->setNext(pred->getNext());
+    pred->setNext(node);
+  }
+  else {
+    // new minimum: a leaf's successor is then its parent
+    node->setNext(node->getParent());
+  }
+}
+
+/**
+* Removes node from the successor chain. Must be called while node is still
+* in its original position, i.e. before spliceOut() or nodeSwap().
+*/
+template<class Key, class Value>
+void BinarySearchTree<Key, Value>::unlinkInOrder(Node<Key, Value>* node)
+{
+  Node<Key, Value>* pred = predecessor(node);
+  if (pred != nullptr) {
+    pred->setNext(node->getNext());
+  }
+}
+
+/**
+* Collects the shape statistics of the tree in one O(n) walk that follows
+* parent pointers back up instead of using a stack or recursion, so it
+* needs O(1) extra space at any depth and does not modify the tree.
+*/
+template<typename Key, typename Value>
+ShapeStats BinarySearchTree<Key, Value>::shapeStats() const
+{
+  ShapeStats stats;
+  Node<Key, Value>* prev = nullptr;
+  Node<Key, Value>* curr = root_;
+  int depth = 0;
+  while (curr != nullptr) {
+    Node<Key, Value>* left = curr->getLeft();
+    Node<Key, Value>* right = curr->getRight();
+    Node<Key, Value>* next;
+    if (prev == curr->getParent()) {
+      // first time here: count it, then go down
+      stats.addNode(depth, (left != nullptr) + (right != nullptr));
+      next = left != nullptr ? left : (right != nullptr ? right : curr->getParent());
+    }
+    else if (prev == left && right != nullptr) {
+      next = right;
+    }
+    else {
+      next = curr->getParent();
+    }
+    depth += (next == curr->getParent()) ? -1 : 1;
+    prev = curr;
+    curr = next;
+  }
+  return stats;
+}
+
 /**
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
@@ -607,18 +1277,90 @@ void BinarySearchTree<Key, Value>::clear() {
   root_ = NULL;
 }
 
+/**
+* Fills this empty tree with copies of other's nodes, made with NodeT's
+* copy constructor so balance, color or rank come along. Walks other
+* without a stack: down to a child not copied yet, otherwise back up
+* through the parents, threading the successor chain as each node's left
+* subtree is finished. O(n), and no rebalancing since the shape is kept.
+*/
+template<typename Key, typename Value>
+template<typename NodeT>
+void BinarySearchTree<Key, Value>::cloneFrom(const BinarySearchTree<Key, Value>& other) {
+  const Node<Key, Value>* src = other.root_;
+  if (src == nullptr) {
+    return;
+  }
+  struct Copy {
+    static Node<Key, Value>* make(const Node<Key, Value>* from, Node<Key, Value>* parent) {
+      NodeT* node = new NodeT(*static_cast<const NodeT*>(from));
+      node->setParent(parent);
+      node->setLeft(nullptr);
+      node->setRight(nullptr);
+      node->setNext(nullptr);
+      return node;
+    }
+  };
+
+  Node<Key, Value>* dst = root_ = Copy::make(src, nullptr);
+  Node<Key, Value>* prev = nullptr;
+  const Node<Key, Value>* from = nullptr; // the child just climbed out of
+  while (src != nullptr) {
+    if (from == nullptr && src->getLeft() != nullptr) {
+      dst->setLeft(Copy::make(src->getLeft(), dst));
+      src = src->getLeft();
+      dst = dst->getLeft();
+      continue;
+    }
+    if (from == nullptr || from == src->getLeft()) {
+      if (prev != nullptr) {
+        prev->setNext(dst);
+      }
+      prev = dst;
+      if (src->getRight() != nullptr) {
+        dst->setRight(Copy::make(src->getRight(), dst));
+        src = src->getRight();
+        dst = dst->getRight();
+        from = nullptr;
+        continue;
+      }
+    }
+    from = src;
+    src = src->getParent();
+    dst = dst->getParent();
+  }
+}
+
+/**
+* Deletes the subtree rooted at node. Rotates left children up until the
+* current node has none, then frees it and moves right, so no stack is
+* needed even for the path-shaped trees a splay tree can form.
+*/
 template<typename Key, typename Value> 
 void BinarySearchTree<Key, Value>::eraseFunc(Node<Key, Value>* node) {
-  if (node == nullptr) {
-    return; // Base case: if current node is null, do nothing.
+  while (node != nullptr) {
+    Node<Key, Value>* left = node->getLeft();
+    if (left != nullptr) {
+      node->setLeft(left->getRight());
+      left->setRight(node);
+      node = left;
+    }
+    else {
+      Node<Key, Value>* right = node->getRight();
+      destroyNode(node);
+      node = right;
+    }
   }
+}
 
-  eraseFunc(node->getLeft());  // Recursively delete the left subtree
-  eraseFunc(node->getRight()); // Recursively delete the right subtree
-  
-  // After left and right children are deleted, delete the current node
+/**
+* Frees a node that has been unlinked from the tree. Every node the tree
+* gives up goes through here.
+*/
+template<typename Key, typename Value>
+void BinarySearchTree<Key, Value>::destroyNode(Node<Key, Value>* node)
+{
   delete node;
-  node = nullptr; // Set the current node's pointer to nullptr to avoid dangling pointers
 }
 
 /**
@@ -649,14 +1391,23 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::getSmallestNodeRecursive(Node<Ke
 template<typename Key, typename Value>
 Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
 {
-    // TODO
-  if (root_ == nullptr) {
-    return nullptr; // return nullptr if the BST is empty
-  }
+  Node<Key, Value>* last;
+  return internalFind(key, last);
+}
 
+/**
+* As above, and also sets last to the last node the descent visited (the
+* node found, or on a miss the leaf-ward end of the search path; NULL only
+* when the tree is empty).
+*/
+template<typename Key, typename Value>
+Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key, Node<Key, Value>*& last) const
+{
+  last = nullptr;
   Node<Key, Value>* currentNode = root_;
 
   while(currentNode != nullptr) {
+    last = currentNode;
     if (currentNode->getKey() == key) { // node with the matching key is found
       return currentNode;
     }
@@ -0,0 +1,233 @@
+#ifndef BSTSET_H
+#define BSTSET_H
+
+#include <utility>
+#include <vector>
+#include "bst.h"
+#include "avlbst.h"
+
+/**
+* Which keys setUnion()/setIntersection()/setDifference() keep.
+*/
+enum SetOperation { SET_UNION, SET_INTERSECTION, SET_DIFFERENCE };
+
+/**
+* Walks the sorted ranges [a, aEnd) and [b, bEnd) side by side, like
+* std::set_union and friends, and appends the keys op keeps to out.
+* O(|a| + |b|).
+*/
+template <class Key, class Iterator>
+void mergeSetKeys(Iterator a, Iterator aEnd, Iterator b, Iterator bEnd, SetOperation op,
+    std::vector<std::pair<Key, NoValue> >& out)
+{
+  while (a != aEnd && b != bEnd) {
+    const Key& x = a->first;
+    const Key& y = b->first;
+    if (x < y) {
+      if (op != SET_INTERSECTION) {
+        out.push_back(std::make_pair(x, NoValue()));
+      }
+      ++a;
+    }
+    else if (y < x) {
+      if (op == SET_UNION) {
+        out.push_back(std::make_pair(y, NoValue()));
+      }
+      ++b;
+    }
+    else {
+      if (op != SET_DIFFERENCE) {
+        out.push_back(std::make_pair(x, NoValue()));
+      }
+      ++a;
+      ++b;
+    }
+  }
+  for (; a != aEnd && op != SET_INTERSECTION; ++a) {
+    out.push_back(std::make_pair(a->first, NoValue()));
+  }
+  for (; b != bEnd && op == SET_UNION; ++b) {
+    out.push_back(std::make_pair(b->first, NoValue()));
+  }
+}
+
+/**
+* An unbalanced search tree of keys alone. Its nodes hold a SetItem
+* instead of a (key, value) pair; *it converts to the key.
+*/
+template <class Key>
+class BSTSet : public BinarySearchTree<Key, NoValue>
+{
+    typedef BinarySearchTree<Key, NoValue> Base;
+
+public:
+    using Base::insert;
+    void insert(const Key& key);
+    bool contains(const Key& key) const;
+
+    void setUnion(const BSTSet<Key>& a, const BSTSet<Key>& b);
+    void setIntersection(const BSTSet<Key>& a, const BSTSet<Key>& b);
+    void setDifference(const BSTSet<Key>& a, const BSTSet<Key>& b);
+
+protected:
+    void assign(const BSTSet<Key>& a, const BSTSet<Key>& b, SetOperation op);
+    Node<Key, NoValue>* buildSubtree(const std::vector<std::pair<Key, NoValue> >& keys,
+        size_t lo, size_t hi, Node<Key, NoValue>*& prev);
+};
+
+template<class Key>
+void BSTSet<Key>::insert(const Key& key)
+{
+  Base::insert(std::make_pair(key, NoValue()));
+}
+
+template<class Key>
+bool BSTSet<Key>::contains(const Key& key) const
+{
+  return this->internalFind(key) != nullptr;
+}
+
+/**
+* Replaces the contents with the keys in a or b. Either may be this set.
+*/
+template<class Key>
+void BSTSet<Key>::setUnion(const BSTSet<Key>& a, const BSTSet<Key>& b)
+{
+  assign(a, b, SET_UNION);
+}
+
+/**
+* Replaces the contents with the keys in both a and b.
+*/
+template<class Key>
+void BSTSet<Key>::setIntersection(const BSTSet<Key>& a, const BSTSet<Key>& b)
+{
+  assign(a, b, SET_INTERSECTION);
+}
+
+/**
+* Replaces the contents with the keys in a but not in b.
+*/
+template<class Key>
+void BSTSet<Key>::setDifference(const BSTSet<Key>& a, const BSTSet<Key>& b)
+{
+  assign(a, b, SET_DIFFERENCE);
+}
+
+/**
+* Merges the two in-order chains into a sorted key list, then rebuilds the
+* tree from it perfectly balanced in O(n), whatever shape a and b had.
+*/
+template<class Key>
+void BSTSet<Key>::assign(const BSTSet<Key>& a, const BSTSet<Key>& b, SetOperation op)
+{
+  std::vector<std::pair<Key, NoValue> > keys;
+  mergeSetKeys<Key>(a.begin(), a.end(), b.begin(), b.end(), op, keys);
+  this->clear();
+  Node<Key, NoValue>* prev = nullptr;
+  this->root_ = buildSubtree(keys, 0, keys.size(), prev);
+}
+
+/**
+* Builds [lo, hi) of keys with its middle key at the root, threading the
+* successor chain through prev as nodes are created in order.
+*/
+template<class Key>
+Node<Key, NoValue>* BSTSet<Key>::buildSubtree(const std::vector<std::pair<Key, NoValue> >& keys,
+    size_t lo, size_t hi, Node<Key, NoValue>*& prev)
+{
+  if (lo >= hi) {
+    return nullptr;
+  }
+  size_t mid = lo + (hi - lo) / 2;
+  Node<Key, NoValue>* left = buildSubtree(keys, lo, mid, prev);
+  Node<Key, NoValue>* node = new Node<Key, NoValue>(keys[mid].first, NoValue(), nullptr);
+  if (prev != nullptr) {
+    prev->setNext(node);
+  }
+  prev = node;
+  Node<Key, NoValue>* right = buildSubtree(keys, mid + 1, hi, prev);
+
+  node->setLeft(left);
+  node->setRight(right);
+  if (left) left->setParent(node);
+  if (right) right->setParent(node);
+  return node;
+}
+
+/**
+* An AVL tree of keys alone, sharing all of AVLTree's insert, remove and
+* rebalancing code.
+*/
+template <class Key>
+class AVLSet : public AVLTree<Key, NoValue>
+{
+    typedef AVLTree<Key, NoValue> Base;
+
+public:
+    using Base::insert;
+    void insert(const Key& key);
+    bool contains(const Key& key) const;
+
+    void setUnion(const AVLSet<Key>& a, const AVLSet<Key>& b);
+    void setIntersection(const AVLSet<Key>& a, const AVLSet<Key>& b);
+    void setDifference(const AVLSet<Key>& a, const AVLSet<Key>& b);
+
+protected:
+    void assign(const AVLSet<Key>& a, const AVLSet<Key>& b, SetOperation op);
+};
+
+template<class Key>
+void AVLSet<Key>::insert(const Key& key)
+{
+  Base::insert(std::make_pair(key, NoValue()));
+}
+
+template<class Key>
+bool AVLSet<Key>::contains(const Key& key) const
+{
+  return this->internalFind(key) != nullptr;
+}
+
+/**
+* Replaces the contents with the keys in a or b. Either may be this set.
+*/
+template<class Key>
+void AVLSet<Key>::setUnion(const AVLSet<Key>& a, const AVLSet<Key>& b)
+{
+  assign(a, b, SET_UNION);
+}
+
+/**
+* Replaces the contents with the keys in both a and b.
+*/
+template<class Key>
+void AVLSet<Key>::setIntersection(const AVLSet<Key>& a, const AVLSet<Key>& b)
+{
+  assign(a, b, SET_INTERSECTION);
+}
+
+/**
+* Replaces the contents with the keys in a but not in b.
+*/
+template<class Key>
+void AVLSet<Key>::setDifference(const AVLSet<Key>& a, const AVLSet<Key>& b)
+{
+  assign(a, b, SET_DIFFERENCE);
+}
+
+/**
+* Linear merge of the two in-order chains, then AVLTree's O(n) bottom-up
+* build; the keys are already sorted and unique, so build()'s sort and
+* dedup pass is skipped.
+*/
+template<class Key>
+void AVLSet<Key>::assign(const AVLSet<Key>& a, const AVLSet<Key>& b, SetOperation op)
+{
+  std::vector<std::pair<Key, NoValue> > keys;
+  mergeSetKeys<Key>(a.begin(), a.end(), b.begin(), b.end(), op, keys);
+  this->clear();
+  this->root_ = this->buildSubtree(keys, 0, keys.size(), 0);
+}
+
+#endif
@@ -0,0 +1,1165 @@
+#ifndef COMPACT_AVLBST_H
+#define COMPACT_AVLBST_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include <new>
+#include <ostream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include <type_traits>
+
+/**
+* Whether a (Key, Value) entry is plain bytes. Stores holding such entries
+* copy and serialize whole node pools with memcpy instead of entry by
+* entry.
+*/
+template<typename Key, typename Value>
+struct TrivialEntry : std::integral_constant<bool,
+    std::is_trivially_copyable<Key>::value && std::is_trivially_copyable<Value>::value>
+{
+};
+
+/**
+* Three-way key comparison: negative, zero or positive as a is less than,
+* equal to or greater than b. Arithmetic keys use (b < a) - (a < b), which
+* compiles to two flag-setting compares and no branch.
+*/
+template<typename Key>
+int compareKeys(const Key& a, const Key& b, std::true_type)
+{
+    return static_cast<int>(b < a) - static_cast<int>(a < b);
+}
+
+template<typename Key>
+int compareKeys(const Key& a, const Key& b, std::false_type)
+{
+    return a < b ? -1 : (b < a ? 1 : 0);
+}
+
+template<typename Key>
+int compareKeys(const Key& a, const Key& b)
+{
+    return compareKeys(a, b, typename std::is_arithmetic<Key>::type());
+}
+
+/**
+* Node stores for CompactAVLTree.
+*
+* AVLNode pays for a vtable pointer, a separate balance byte padded out to
+* a whole word and a successor link. The stores below drop all three: the
+* balance lives in the low bits of the parent link, nodes have no virtual
+* functions, and the key sits at the start of the node next to the child
+* links. Balances need three bits rather than two because a node is
+* briefly at +2/-2 in the middle of a double rotation.
+*
+* A store hands out opaque references (Ref) and the tree only ever talks
+* to nodes through it, so the same AVL code runs on either layout:
+*
+*  - PointerNodeStore: heap nodes linked by pointers, the balance tagged
+*    into the parent pointer. 40 bytes per <uint64_t, uint64_t> entry.
+*  - IndexNodeStore: nodes in one std::vector linked by 32-bit indices,
+*    the balance tagged into the parent index, freed slots reused through
+*    a free list. 32 bytes per <uint64_t, uint64_t> entry, up to 2^29 - 1
+*    entries per tree. Since nodes are addressed by index rather than by
+*    address, the pool can be compacted and relocated (see compact()).
+*/
+template<typename Key, typename Value>
+class PointerNodeStore
+{
+public:
+    struct alignas(8) CompactNode
+    {
+        CompactNode(const Key& key, const Value& value, uintptr_t parentBalance) :
+            item(key, value), left(NULL), right(NULL), parentBalance(parentBalance)
+        {
+
+        }
+
+        std::pair<const Key, Value> item;
+        CompactNode* left;
+        CompactNode* right;
+        uintptr_t parentBalance;    // parent pointer | (balance + 2)
+    };
+    typedef CompactNode* Ref;
+
+    static Ref nil() { return NULL; }
+    static size_t nodeSize() { return sizeof(CompactNode); }
+
+    Ref create(const Key& key, const Value& value, Ref parent);
+    void destroy(Ref node);
+    void clear(Ref root);
+    Ref copy(const PointerNodeStore<Key, Value>& from, Ref root);
+
+    std::pair<const Key, Value>& item(Ref node) { return node->item; }
+    Ref left(Ref node) { return node->left; }
+    Ref right(Ref node) { return node->right; }
+    Ref parent(Ref node) { return reinterpret_cast<Ref>(node->parentBalance & ~TAG_MASK); }
+    int balance(Ref node) { return static_cast<int>(node->parentBalance & TAG_MASK) - 2; }
+
+    void setLeft(Ref node, Ref left) { node->left = left; }
+    void setRight(Ref node, Ref right) { node->right = right; }
+    void setParent(Ref node, Ref parent)
+    {
+        node->parentBalance = reinterpret_cast<uintptr_t>(parent) | (node->parentBalance & TAG_MASK);
+    }
+    void setBalance(Ref node, int balance)
+    {
+        node->parentBalance = (node->parentBalance & ~TAG_MASK) | static_cast<uintptr_t>(balance + 2);
+    }
+
+private:
+    static const uintptr_t TAG_MASK = 7;
+
+    static Ref cloneSubtree(Ref node, Ref parent);
+};
+
+template<typename Key, typename Value>
+typename PointerNodeStore<Key, Value>::Ref
+PointerNodeStore<Key, Value>::create(const Key& key, const Value& value, Ref parent)
+{
+    return new CompactNode(key, value, reinterpret_cast<uintptr_t>(parent) | 2);
+}
+
+template<typename Key, typename Value>
+void PointerNodeStore<Key, Value>::destroy(Ref node)
+{
+    delete node;
+}
+
+/**
+* Deletes a whole subtree without recursion: descend to a leaf, cut it
+* off from its parent, delete it and continue from the parent.
+*/
+template<typename Key, typename Value>
+void PointerNodeStore<Key, Value>::clear(Ref root)
+{
+    Ref node = root;
+    while(node != NULL) {
+        if(node->left != NULL) {
+            node = node->left;
+        }
+        else if(node->right != NULL) {
+            node = node->right;
+        }
+        else {
+            Ref up = parent(node);
+            if(up != NULL) {
+                if(up->left == node) up->left = NULL;
+                else up->right = NULL;
+            }
+            delete node;
+            node = up;
+        }
+    }
+}
+
+/**
+* Deep-copies the subtree at root (a tree of from's) and returns the copy.
+* Recursion depth is the tree height.
+*/
+template<typename Key, typename Value>
+typename PointerNodeStore<Key, Value>::Ref
+PointerNodeStore<Key, Value>::copy(const PointerNodeStore<Key, Value>&, Ref root)
+{
+    return cloneSubtree(root, NULL);
+}
+
+template<typename Key, typename Value>
+typename PointerNodeStore<Key, Value>::Ref
+PointerNodeStore<Key, Value>::cloneSubtree(Ref node, Ref parent)
+{
+    if(node == NULL) {
+        return NULL;
+    }
+    Ref copy = new CompactNode(node->item.first, node->item.second,
+        reinterpret_cast<uintptr_t>(parent) | (node->parentBalance & TAG_MASK));
+    copy->left = cloneSubtree(node->left, copy);
+    copy->right = cloneSubtree(node->right, copy);
+    return copy;
+}
+
+/**
+* Orders compact() can lay the live nodes out in.
+*/
+enum CompactOrder {
+    COMPACT_IN_ORDER,   // key order: full scans walk memory sequentially
+    COMPACT_BFS         // level order: the top levels every search touches share cache lines
+};
+
+template<typename Key, typename Value>
+class IndexNodeStore
+{
+public:
+    typedef uint32_t Ref;   // 1-based slot index, 0 is nil
+
+    static Ref nil() { return 0; }
+    static size_t nodeSize() { return sizeof(Slot); }
+
+    IndexNodeStore() : freeHead_(0), live_(0) { }
+
+    Ref create(const Key& key, const Value& value, Ref parent);
+    void destroy(Ref node);
+    void clear(Ref root);
+    void compact(Ref& root, CompactOrder order, std::vector<Ref>* remap);
+    size_t capacity() const { return slots_.capacity(); }
+    Ref copy(const IndexNodeStore<Key, Value>& from, Ref root);
+    void save(std::ostream& out, Ref root) const;
+    Ref load(std::istream& in, size_t& count);
+
+    std::pair<const Key, Value>& item(Ref node) { return slot(node).item(); }
+    Ref left(Ref node) { return slot(node).left; }
+    Ref right(Ref node) { return slot(node).right; }
+    Ref parent(Ref node) { return slot(node).parentBalance >> TAG_BITS; }
+    int balance(Ref node) { return static_cast<int>(slot(node).parentBalance & TAG_MASK) - 2; }
+
+    void setLeft(Ref node, Ref left) { slot(node).left = left; }
+    void setRight(Ref node, Ref right) { slot(node).right = right; }
+    void setParent(Ref node, Ref parent)
+    {
+        Slot& s = slot(node);
+        s.parentBalance = (parent << TAG_BITS) | (s.parentBalance & TAG_MASK);
+    }
+    void setBalance(Ref node, int balance)
+    {
+        Slot& s = slot(node);
+        s.parentBalance = (s.parentBalance & ~TAG_MASK) | static_cast<uint32_t>(balance + 2);
+    }
+
+protected:
+    static const uint32_t TAG_BITS = 3;
+    static const uint32_t TAG_MASK = 7;
+    static const uint32_t FREE = 0xFFFFFFFF;   // parentBalance of a slot on the free list
+    static const uint32_t MAX_NODES = (1u << (32 - TAG_BITS)) - 1;
+
+    typedef std::pair<const Key, Value> Item;
+
+    /**
+    * One pool entry. A free slot reuses the item's storage for the free
+    * list link, so it costs nothing beyond the live layout.
+    */
+    struct OwningSlot
+    {
+        union {
+            Item stored;
+            Ref nextFree;
+        };
+        Ref left;
+        Ref right;
+        uint32_t parentBalance;
+
+        OwningSlot() : nextFree(0), left(0), right(0), parentBalance(FREE) { }
+        OwningSlot(const OwningSlot& other) : left(other.left), right(other.right), parentBalance(other.parentBalance)
+        {
+            if(parentBalance == FREE) nextFree = other.nextFree;
+            else new (&stored) Item(other.stored);
+        }
+        OwningSlot(OwningSlot&& other) noexcept(std::is_nothrow_move_constructible<Item>::value) :
+            left(other.left), right(other.right), parentBalance(other.parentBalance)
+        {
+            if(parentBalance == FREE) nextFree = other.nextFree;
+            else new (&stored) Item(std::move(other.stored));
+        }
+        ~OwningSlot()
+        {
+            if(parentBalance != FREE) stored.~Item();
+        }
+        Item& item() { return stored; }
+
+    private:
+        OwningSlot& operator=(const OwningSlot&);
+    };
+
+    /**
+    * The same layout for trivially copyable entries, with the item kept as
+    * raw bytes: pair<const Key, Value> is never trivially copyable itself,
+    * and this slot has to be for copy(), save() and load() to move whole
+    * pools with memcpy.
+    */
+    struct TrivialSlot
+    {
+        union {
+            typename std::aligned_storage<sizeof(Item), alignof(Item)>::type stored;
+            Ref nextFree;
+        };
+        Ref left;
+        Ref right;
+        uint32_t parentBalance;
+
+        TrivialSlot() : nextFree(0), left(0), right(0), parentBalance(FREE) { }
+        Item& item() { return *reinterpret_cast<Item*>(&stored); }
+    };
+
+    typedef typename std::conditional<TrivialEntry<Key, Value>::value, TrivialSlot, OwningSlot>::type Slot;
+
+    Slot& slot(Ref node) { return slots_[node - 1]; }
+    void copySlots(const std::vector<Slot>& from, std::true_type);
+    void copySlots(const std::vector<Slot>& from, std::false_type);
+    static bool validate(std::vector<Slot>& slots, Ref root, Ref freeHead, size_t live);
+
+    std::vector<Slot> slots_;
+    Ref freeHead_;
+    size_t live_;
+};
+
+template<typename Key, typename Value>
+typename IndexNodeStore<Key, Value>::Ref
+IndexNodeStore<Key, Value>::create(const Key& key, const Value& value, Ref parent)
+{
+    Ref node = freeHead_;
+    if(node != 0) {
+        freeHead_ = slot(node).nextFree;
+    }
+    else {
+        if(slots_.size() >= MAX_NODES) {
+            throw std::length_error("IndexNodeStore: too many nodes");
+        }
+        slots_.push_back(Slot());
+        node = static_cast<Ref>(slots_.size());
+    }
+    Slot& s = slot(node);
+    new (&s.item()) Item(key, value);
+    ++live_;
+    s.left = 0;
+    s.right = 0;
+    s.parentBalance = (parent << TAG_BITS) | 2;
+    return node;
+}
+
+template<typename Key, typename Value>
+void IndexNodeStore<Key, Value>::destroy(Ref node)
+{
+    Slot& s = slot(node);
+    s.item().~Item();
+    s.parentBalance = FREE;
+    s.nextFree = freeHead_;
+    freeHead_ = node;
+    --live_;
+}
+
+/**
+* Every node of a tree lives in the one pool, so clearing it does not
+* have to walk the tree at all.
+*/
+template<typename Key, typename Value>
+void IndexNodeStore<Key, Value>::clear(Ref)
+{
+    std::vector<Slot>().swap(slots_);
+    freeHead_ = 0;
+    live_ = 0;
+}
+
+/**
+* Moves every live node into a new pool holding exactly the live nodes, in
+* the given order, rewrites all links and root, and frees the old pool.
+* Handles (Refs) change; if remap is given, (*remap)[old] is set to the new
+* Ref of every old live Ref and to nil for freed ones.
+*/
+template<typename Key, typename Value>
+void IndexNodeStore<Key, Value>::compact(Ref& root, CompactOrder order, std::vector<Ref>* remap)
+{
+    std::vector<Ref> layout;
+    layout.reserve(live_);
+    if(root != 0 && order == COMPACT_BFS) {
+        layout.push_back(root);
+        for(size_t i = 0; i < layout.size(); ++i) {
+            if(left(layout[i]) != 0) layout.push_back(left(layout[i]));
+            if(right(layout[i]) != 0) layout.push_back(right(layout[i]));
+        }
+    }
+    else if(root != 0) {
+        // in-order without a stack: climb parent links back up
+        Ref node = root;
+        while(left(node) != 0) node = left(node);
+        while(node != 0) {
+            layout.push_back(node);
+            if(right(node) != 0) {
+                node = right(node);
+                while(left(node) != 0) node = left(node);
+            }
+            else {
+                Ref up = parent(node);
+                while(up != 0 && node == right(up)) {
+                    node = up;
+                    up = parent(node);
+                }
+                node = up;
+            }
+        }
+    }
+
+    std::vector<Ref> newRef(slots_.size() + 1, 0);
+    for(size_t i = 0; i < layout.size(); ++i) {
+        newRef[layout[i]] = static_cast<Ref>(i + 1);
+    }
+
+    std::vector<Slot> fresh;
+    fresh.reserve(layout.size());
+    for(size_t i = 0; i < layout.size(); ++i) {
+        Slot& old = slot(layout[i]);
+        fresh.push_back(std::move(old));
+        Slot& moved = fresh.back();
+        moved.left = newRef[old.left];
+        moved.right = newRef[old.right];
+        moved.parentBalance = (newRef[old.parentBalance >> TAG_BITS] << TAG_BITS) | (old.parentBalance & TAG_MASK);
+    }
+
+    root = newRef[root];
+    slots_.swap(fresh);
+    freeHead_ = 0;
+    if(remap != NULL) {
+        remap->swap(newRef);
+    }
+    std::vector<Slot>().swap(fresh);
+}
+
+/**
+* Takes a copy of from's whole pool. Links are indices, so the copy needs
+* no fixing up and root stays the same; with trivially copyable entries
+* the pool is copied with one memcpy.
+*/
+template<typename Key, typename Value>
+typename IndexNodeStore<Key, Value>::Ref
+IndexNodeStore<Key, Value>::copy(const IndexNodeStore<Key, Value>& from, Ref root)
+{
+    copySlots(from.slots_, typename TrivialEntry<Key, Value>::type());
+    freeHead_ = from.freeHead_;
+    live_ = from.live_;
+    return root;
+}
+
+template<typename Key, typename Value>
+void IndexNodeStore<Key, Value>::copySlots(const std::vector<Slot>& from, std::true_type)
+{
+    static_assert(std::is_trivially_copyable<Slot>::value, "memcpy of the pool needs trivially copyable slots");
+    std::vector<Slot> slots(from.size());
+    if(!from.empty()) {
+        std::memcpy(static_cast<void*>(slots.data()), from.data(), from.size() * sizeof(Slot));
+    }
+    slots_.swap(slots);
+}
+
+template<typename Key, typename Value>
+void IndexNodeStore<Key, Value>::copySlots(const std::vector<Slot>& from, std::false_type)
+{
+    std::vector<Slot>(from).swap(slots_);
+}
+
+/**
+* Writes the pool as raw bytes after a small header: one write, however
+* many nodes. Trivially copyable entries only; the format is that of this
+* build (endianness, sizeof(Key), sizeof(Value)) and is not meant to be
+* portable.
+*/
+template<typename Key, typename Value>
+void IndexNodeStore<Key, Value>::save(std::ostream& out, Ref root) const
+{
+    static_assert(TrivialEntry<Key, Value>::value, "save() needs trivially copyable keys and values");
+    static_assert(std::is_trivially_copyable<Slot>::value, "save() writes slots as raw bytes");
+    uint64_t header[5] = { sizeof(Slot), slots_.size(), root, freeHead_, live_ };
+    out.write(reinterpret_cast<const char*>(header), sizeof(header));
+    if(!slots_.empty()) {
+        out.write(static_cast<const char*>(static_cast<const void*>(slots_.data())), slots_.size() * sizeof(Slot));
+    }
+}
+
+/**
+* Replaces the pool with one written by save() and returns its root;
+* count is set to the number of live nodes. Throws std::runtime_error on
+* short or mismatched input, or on a pool whose links do not form one
+* tree plus a free list (see validate()), leaving the store as it was.
+*/
+template<typename Key, typename Value>
+typename IndexNodeStore<Key, Value>::Ref
+IndexNodeStore<Key, Value>::load(std::istream& in, size_t& count)
+{
+    static_assert(TrivialEntry<Key, Value>::value, "load() needs trivially copyable keys and values");
+    static_assert(std::is_trivially_copyable<Slot>::value, "load() reads slots as raw bytes");
+    uint64_t header[5];
+    if(!in.read(reinterpret_cast<char*>(header), sizeof(header))
+        || header[0] != sizeof(Slot) || header[1] > MAX_NODES
+        || header[2] > header[1] || header[3] > header[1] || header[4] > header[1]) {
+        throw std::runtime_error("IndexNodeStore: bad header");
+    }
+    std::vector<Slot> slots(header[1]);
+    if(!slots.empty()
+        && !in.read(static_cast<char*>(static_cast<void*>(slots.data())), slots.size() * sizeof(Slot))) {
+        throw std::runtime_error("IndexNodeStore: truncated input");
+    }
+    if(!validate(slots, static_cast<Ref>(header[2]), static_cast<Ref>(header[3]), header[4])) {
+        throw std::runtime_error("IndexNodeStore: corrupt pool");
+    }
+    slots_.swap(slots);
+    freeHead_ = static_cast<Ref>(header[3]);
+    live_ = header[4];
+    count = live_;
+    return static_cast<Ref>(header[2]);
+}
+
+/**
+* Checks in O(n) that a pool read by load() is one the tree code can walk
+* without leaving it: every link is in range and child and parent links
+* agree; the free list ends and holds every free slot; the live nodes are
+* exactly those reachable from root; every balance is the real height
+* difference of its subtrees; and keys increase in order.
+*/
+template<typename Key, typename Value>
+bool IndexNodeStore<Key, Value>::validate(std::vector<Slot>& slots, Ref root, Ref freeHead, size_t live)
+{
+    size_t n = slots.size();
+    size_t freeSlots = 0;
+    for(size_t i = 1; i <= n; ++i) {
+        Slot& s = slots[i - 1];
+        if(s.parentBalance == FREE) {
+            ++freeSlots;
+            if(s.nextFree > n) return false;
+            continue;
+        }
+        Ref up = s.parentBalance >> TAG_BITS;
+        uint32_t tag = s.parentBalance & TAG_MASK;
+        if(s.left > n || s.right > n || up > n || tag < 1 || tag > 3) return false;
+        if(s.left != 0 && (s.left == s.right || slots[s.left - 1].parentBalance == FREE
+            || (slots[s.left - 1].parentBalance >> TAG_BITS) != i)) return false;
+        if(s.right != 0 && (slots[s.right - 1].parentBalance == FREE
+            || (slots[s.right - 1].parentBalance >> TAG_BITS) != i)) return false;
+        if(up == 0 ? i != root : (slots[up - 1].parentBalance == FREE
+            || (slots[up - 1].left != i && slots[up - 1].right != i))) return false;
+    }
+    if(freeSlots + live != n || (root == 0) != (live == 0)) {
+        return false;
+    }
+    if(root != 0 && (slots[root - 1].parentBalance >> TAG_BITS) != 0) {
+        return false;   // also rules out a free root: FREE has parent bits set
+    }
+
+    // every link on the list is a free slot and there are freeSlots of them,
+    // so a cycle runs past the count
+    size_t listed = 0;
+    for(Ref node = freeHead; node != 0; node = slots[node - 1].nextFree) {
+        if(slots[node - 1].parentBalance != FREE || ++listed > freeSlots) return false;
+    }
+    if(listed != freeSlots) {
+        return false;
+    }
+
+    // each node has one parent that links to it, so no node is reached twice
+    std::vector<Ref> order;     // preorder: every node before its children
+    order.reserve(live);
+    if(root != 0) order.push_back(root);
+    for(size_t i = 0; i < order.size(); ++i) {
+        if(order.size() > live) return false;
+        Slot& s = slots[order[i] - 1];
+        if(s.left != 0) order.push_back(s.left);
+        if(s.right != 0) order.push_back(s.right);
+    }
+    if(order.size() != live) {
+        return false;
+    }
+
+    // heights bottom-up: every stored balance must be the real one, or the
+    // fix-ups walk off the top of the tree
+    std::vector<int> height(n + 1, 0);
+    for(size_t i = order.size(); i-- > 0; ) {
+        Slot& s = slots[order[i] - 1];
+        int left = height[s.left];
+        int right = height[s.right];
+        if(right - left != static_cast<int>(s.parentBalance & TAG_MASK) - 2) return false;
+        height[order[i]] = 1 + (left > right ? left : right);
+    }
+
+    // keys strictly increase in order
+    std::vector<Ref> stack;
+    const Key* prev = NULL;
+    for(Ref node = root; node != 0 || !stack.empty(); ) {
+        for(; node != 0; node = slots[node - 1].left) {
+            stack.push_back(node);
+        }
+        node = stack.back();
+        stack.pop_back();
+        const Key& key = slots[node - 1].item().first;
+        if(prev != NULL && !(*prev < key)) return false;
+        prev = &key;
+        node = slots[node - 1].right;
+    }
+    return true;
+}
+
+
+/**
+* An AVL tree with the same interface as AVLTree, built on a compact node
+* store instead of Node/AVLNode. There are no virtual functions and no
+* successor links, so the iterator climbs parent links like the original
+* BinarySearchTree::iterator did; in exchange each entry costs roughly
+* half the overhead of an AVLNode.
+*
+* Two-child removes relink the predecessor into the removed node's place,
+* so iterators to other entries stay valid across insert and remove. With
+* IndexNodeStore an insert may move the pool, so references into items
+* (not iterators) can be invalidated by insert.
+*/
+template<typename Key, typename Value, typename Store = PointerNodeStore<Key, Value> >
+class CompactAVLTree
+{
+public:
+    typedef typename Store::Ref Ref;
+
+    CompactAVLTree();
+    CompactAVLTree(const CompactAVLTree<Key, Value, Store>& other);
+    CompactAVLTree<Key, Value, Store>& operator=(const CompactAVLTree<Key, Value, Store>& other);
+    ~CompactAVLTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    static size_t nodeSize();
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class CompactAVLTree<Key, Value, Store>;
+        iterator(const CompactAVLTree<Key, Value, Store>* tree, Ref node);
+        const CompactAVLTree<Key, Value, Store>* tree_;
+        Ref current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Ref handle(const iterator& it) const;
+    iterator at(Ref handle) const;
+    void compact(CompactOrder order = COMPACT_BFS, std::vector<Ref>* remap = NULL);
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    void save(std::ostream& out) const;
+    void load(std::istream& in);
+
+protected:
+    Ref internalFind(const Key& key) const;
+    Ref successor(Ref node) const;
+    void replaceChild(Ref parent, Ref oldChild, Ref newChild);
+    Ref rotateLeft(Ref x);
+    Ref rotateRight(Ref y);
+    Ref balanceTree(Ref node);
+    void insertFix(Ref parent, Ref child);
+    void removeFix(Ref parent, bool leftShrank);
+
+    mutable Store store_;
+    Ref root_;
+    size_t size_;
+};
+
+/*
+-----------------------------------------------------------
+Begin implementations for the CompactAVLTree::iterator class.
+-----------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Store>
+CompactAVLTree<Key, Value, Store>::iterator::iterator() : tree_(NULL), current_(Store::nil())
+{
+
+}
+
+template<typename Key, typename Value, typename Store>
+CompactAVLTree<Key, Value, Store>::iterator::iterator(const CompactAVLTree<Key, Value, Store>* tree, Ref node) :
+    tree_(tree), current_(node)
+{
+
+}
+
+template<typename Key, typename Value, typename Store>
+std::pair<const Key, Value>& CompactAVLTree<Key, Value, Store>::iterator::operator*() const
+{
+    return tree_->store_.item(current_);
+}
+
+template<typename Key, typename Value, typename Store>
+std::pair<const Key, Value>* CompactAVLTree<Key, Value, Store>::iterator::operator->() const
+{
+    return &(tree_->store_.item(current_));
+}
+
+template<typename Key, typename Value, typename Store>
+bool CompactAVLTree<Key, Value, Store>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<typename Key, typename Value, typename Store>
+bool CompactAVLTree<Key, Value, Store>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::iterator&
+CompactAVLTree<Key, Value, Store>::iterator::operator++()
+{
+    current_ = tree_->successor(current_);
+    return *this;
+}
+
+/*
+---------------------------------------------------------
+End implementations for the CompactAVLTree::iterator class.
+---------------------------------------------------------
+*/
+
+template<typename Key, typename Value, typename Store>
+CompactAVLTree<Key, Value, Store>::CompactAVLTree() : root_(Store::nil()), size_(0)
+{
+
+}
+
+/**
+* A deep copy, in O(n). With IndexNodeStore and trivially copyable entries
+* it is a single memcpy of the node pool.
+*/
+template<typename Key, typename Value, typename Store>
+CompactAVLTree<Key, Value, Store>::CompactAVLTree(const CompactAVLTree<Key, Value, Store>& other) :
+    root_(Store::nil()), size_(other.size_)
+{
+    root_ = store_.copy(other.store_, other.root_);
+}
+
+template<typename Key, typename Value, typename Store>
+CompactAVLTree<Key, Value, Store>& CompactAVLTree<Key, Value, Store>::operator=(
+    const CompactAVLTree<Key, Value, Store>& other)
+{
+    if(this != &other) {
+        clear();
+        root_ = store_.copy(other.store_, other.root_);
+        size_ = other.size_;
+    }
+    return *this;
+}
+
+template<typename Key, typename Value, typename Store>
+CompactAVLTree<Key, Value, Store>::~CompactAVLTree()
+{
+    clear();
+}
+
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::clear()
+{
+    store_.clear(root_);
+    root_ = Store::nil();
+    size_ = 0;
+}
+
+template<typename Key, typename Value, typename Store>
+bool CompactAVLTree<Key, Value, Store>::empty() const
+{
+    return root_ == Store::nil();
+}
+
+template<typename Key, typename Value, typename Store>
+size_t CompactAVLTree<Key, Value, Store>::size() const
+{
+    return size_;
+}
+
+/**
+* Bytes used by one entry's node, for capacity planning.
+*/
+template<typename Key, typename Value, typename Store>
+size_t CompactAVLTree<Key, Value, Store>::nodeSize()
+{
+    return Store::nodeSize();
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::iterator
+CompactAVLTree<Key, Value, Store>::begin() const
+{
+    Ref node = root_;
+    if(node != Store::nil()) {
+        while(store_.left(node) != Store::nil()) {
+            node = store_.left(node);
+        }
+    }
+    return iterator(this, node);
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::iterator
+CompactAVLTree<Key, Value, Store>::end() const
+{
+    return iterator(this, Store::nil());
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::iterator
+CompactAVLTree<Key, Value, Store>::find(const Key& key) const
+{
+    return iterator(this, internalFind(key));
+}
+
+/**
+* The handle of the entry an iterator refers to. With IndexNodeStore this
+* is a 32-bit index that stays valid across inserts and removes of other
+* entries (even when the pool is reallocated) until the next compact().
+*/
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::Ref
+CompactAVLTree<Key, Value, Store>::handle(const iterator& it) const
+{
+    return it.current_;
+}
+
+/**
+* An iterator to the entry with the given handle.
+*/
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::iterator
+CompactAVLTree<Key, Value, Store>::at(Ref handle) const
+{
+    return iterator(this, handle);
+}
+
+/**
+* IndexNodeStore only: relocates all live nodes into a dense pool laid out
+* in the given order and returns the old pool (and the holes left by
+* removes) to the allocator. Invalidates all iterators and handles; pass
+* remap to translate old handles. O(n).
+*
+* A pool past the allocator's mmap threshold goes straight back to the OS.
+* Smaller ones stay in the process heap; trimming that (malloc_trim() on
+* glibc) costs time in proportion to the whole heap, so it is left to the
+* caller.
+*/
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::compact(CompactOrder order, std::vector<Ref>* remap)
+{
+    store_.compact(root_, order, remap);
+}
+
+template<typename Key, typename Value, typename Store>
+Value& CompactAVLTree<Key, Value, Store>::operator[](const Key& key)
+{
+    Ref node = internalFind(key);
+    if(node == Store::nil()) throw std::out_of_range("Invalid key");
+    return store_.item(node).second;
+}
+
+template<typename Key, typename Value, typename Store>
+Value const & CompactAVLTree<Key, Value, Store>::operator[](const Key& key) const
+{
+    Ref node = internalFind(key);
+    if(node == Store::nil()) throw std::out_of_range("Invalid key");
+    return store_.item(node).second;
+}
+
+/**
+* IndexNodeStore with trivially copyable entries only: writes the tree as
+* its raw node pool, which load() reads back without rebuilding anything.
+*/
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::save(std::ostream& out) const
+{
+    store_.save(out, root_);
+}
+
+/**
+* Replaces the contents with a tree written by save(). Invalidates all
+* iterators and handles.
+*/
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::load(std::istream& in)
+{
+    size_t count = 0;
+    Ref root = store_.load(in, count);
+    root_ = root;
+    size_ = count;
+}
+
+/**
+* One three-way compare per level; the only branch left in the loop is
+* the rarely taken exit on a match, the child is picked by a select.
+*/
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::Ref
+CompactAVLTree<Key, Value, Store>::internalFind(const Key& key) const
+{
+    Ref node = root_;
+    while(node != Store::nil()) {
+        int cmp = compareKeys(key, store_.item(node).first);
+        if(cmp == 0) {
+            return node;
+        }
+        node = cmp < 0 ? store_.left(node) : store_.right(node);
+    }
+    return node;
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::Ref
+CompactAVLTree<Key, Value, Store>::successor(Ref node) const
+{
+    if(store_.right(node) != Store::nil()) {
+        node = store_.right(node);
+        while(store_.left(node) != Store::nil()) {
+            node = store_.left(node);
+        }
+        return node;
+    }
+    Ref parent = store_.parent(node);
+    while(parent != Store::nil() && node == store_.right(parent)) {
+        node = parent;
+        parent = store_.parent(node);
+    }
+    return parent;
+}
+
+/**
+* Points whichever link referred to oldChild (parent's child link, or
+* root_ if parent is nil) at newChild.
+*/
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::replaceChild(Ref parent, Ref oldChild, Ref newChild)
+{
+    if(parent == Store::nil()) {
+        root_ = newChild;
+    }
+    else if(store_.left(parent) == oldChild) {
+        store_.setLeft(parent, newChild);
+    }
+    else {
+        store_.setRight(parent, newChild);
+    }
+}
+
+/**
+* Same rotation and balance bookkeeping as AVLTree::rotateLeft.
+*/
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::Ref
+CompactAVLTree<Key, Value, Store>::rotateLeft(Ref x)
+{
+    Ref y = store_.right(x);
+    Ref inner = store_.left(y);
+    Ref parent = store_.parent(x);
+
+    store_.setRight(x, inner);
+    if(inner != Store::nil()) {
+        store_.setParent(inner, x);
+    }
+    store_.setParent(y, parent);
+    replaceChild(parent, x, y);
+    store_.setLeft(y, x);
+    store_.setParent(x, y);
+
+    int xb = store_.balance(x);
+    int yb = store_.balance(y);
+    int newXb = xb - 1 - (yb > 0 ? yb : 0);
+    store_.setBalance(x, newXb);
+    store_.setBalance(y, yb - 1 + (newXb < 0 ? newXb : 0));
+    return y;
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::Ref
+CompactAVLTree<Key, Value, Store>::rotateRight(Ref y)
+{
+    Ref x = store_.left(y);
+    Ref inner = store_.right(x);
+    Ref parent = store_.parent(y);
+
+    store_.setLeft(y, inner);
+    if(inner != Store::nil()) {
+        store_.setParent(inner, y);
+    }
+    store_.setParent(x, parent);
+    replaceChild(parent, y, x);
+    store_.setRight(x, y);
+    store_.setParent(y, x);
+
+    int xb = store_.balance(x);
+    int yb = store_.balance(y);
+    int newYb = yb + 1 - (xb < 0 ? xb : 0);
+    store_.setBalance(y, newYb);
+    store_.setBalance(x, xb + 1 + (newYb > 0 ? newYb : 0));
+    return x;
+}
+
+template<typename Key, typename Value, typename Store>
+typename CompactAVLTree<Key, Value, Store>::Ref
+CompactAVLTree<Key, Value, Store>::balanceTree(Ref node)
+{
+    if(store_.balance(node) > 1) {
+        if(store_.balance(store_.right(node)) < 0) {
+            rotateRight(store_.right(node));
+        }
+        return rotateLeft(node);
+    }
+    else if(store_.balance(node) < -1) {
+        if(store_.balance(store_.left(node)) > 0) {
+            rotateLeft(store_.left(node));
+        }
+        return rotateRight(node);
+    }
+    return node;
+}
+
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::insertFix(Ref parent, Ref child)
+{
+    while(parent != Store::nil()) {
+        int balance = store_.balance(parent) + (child == store_.left(parent) ? -1 : 1);
+        store_.setBalance(parent, balance);
+        if(balance == 0) {
+            return;
+        }
+        if(balance == 1 || balance == -1) {
+            child = parent;
+            parent = store_.parent(parent);
+            continue;
+        }
+        balanceTree(parent);
+        return;
+    }
+}
+
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::removeFix(Ref parent, bool leftShrank)
+{
+    while(parent != Store::nil()) {
+        int balance = store_.balance(parent) + (leftShrank ? 1 : -1);
+        store_.setBalance(parent, balance);
+        if(balance == 1 || balance == -1) {
+            return;
+        }
+
+        Ref top = parent;
+        if(balance != 0) {
+            Ref sibling = balance > 0 ? store_.right(parent) : store_.left(parent);
+            bool siblingLevel = store_.balance(sibling) == 0;
+            top = balanceTree(parent);
+            if(siblingLevel) {
+                return;
+            }
+        }
+
+        parent = store_.parent(top);
+        if(parent != Store::nil()) {
+            leftShrank = (top == store_.left(parent));
+        }
+    }
+}
+
+/**
+* Recall: If key is already in the tree, the value is overwritten.
+*/
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    Ref parent = Store::nil();
+    Ref node = root_;
+    bool goLeft = false;
+    while(node != Store::nil()) {
+        int cmp = compareKeys(keyValuePair.first, store_.item(node).first);
+        if(cmp == 0) {
+            store_.item(node).second = keyValuePair.second;
+            return;
+        }
+        goLeft = cmp < 0;
+        parent = node;
+        node = goLeft ? store_.left(node) : store_.right(node);
+    }
+
+    node = store_.create(keyValuePair.first, keyValuePair.second, parent);
+    ++size_;
+    if(parent == Store::nil()) {
+        root_ = node;
+        return;
+    }
+    if(goLeft) {
+        store_.setLeft(parent, node);
+    }
+    else {
+        store_.setRight(parent, node);
+    }
+    insertFix(parent, node);
+}
+
+/**
+* Removes key if present. A node with two children is replaced by its
+* predecessor, which is unlinked from its own spot and relinked in place;
+* no payload is copied or moved.
+*/
+template<typename Key, typename Value, typename Store>
+void CompactAVLTree<Key, Value, Store>::remove(const Key& key)
+{
+    Ref node = internalFind(key);
+    if(node == Store::nil()) {
+        return;
+    }
+
+    Ref parent = store_.parent(node);
+    Ref left = store_.left(node);
+    Ref right = store_.right(node);
+    Ref fixFrom;
+    bool leftShrank;
+
+    if(left != Store::nil() && right != Store::nil()) {
+        Ref pred = left;
+        while(store_.right(pred) != Store::nil()) {
+            pred = store_.right(pred);
+        }
+
+        if(pred == left) {
+            // pred keeps its left subtree and moves up one level
+            fixFrom = pred;
+            leftShrank = true;
+        }
+        else {
+            Ref predParent = store_.parent(pred);
+            Ref predChild = store_.left(pred);
+            store_.setRight(predParent, predChild);
+            if(predChild != Store::nil()) {
+                store_.setParent(predChild, predParent);
+            }
+            store_.setLeft(pred, left);
+            store_.setParent(left, pred);
+            fixFrom = predParent;
+            leftShrank = false;
+        }
+        store_.setRight(pred, right);
+        store_.setParent(right, pred);
+        store_.setParent(pred, parent);
+        store_.setBalance(pred, store_.balance(node));
+        replaceChild(parent, node, pred);
+    }
+    else {
+        Ref child = (left != Store::nil()) ? left : right;
+        if(child != Store::nil()) {
+            store_.setParent(child, parent);
+        }
+        fixFrom = parent;
+        leftShrank = (parent != Store::nil() && store_.left(parent) == node);
+        replaceChild(parent, node, child);
+    }
+
+    store_.destroy(node);
+    --size_;
+    removeFix(fixFrom, leftShrank);
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <string>
+#include <cstdlib>
+#include <chrono>
+#include "equal-paths.h"
+#include "equal-paths-fast.h"
+
+using namespace std;
+
+/**
+ * Builds trees out of one preallocated vector so that building them does
+ * not dominate the run.
+ */
+class TreeBuilder
+{
+public:
+    explicit TreeBuilder(size_t capacity) { nodes_.reserve(capacity); }
+
+    Node* make(int key, Node* left = NULL, Node* right = NULL)
+    {
+        nodes_.push_back(Node(key, left, right));
+        return &nodes_.back();
+    }
+
+    // a perfect tree with `levels` levels
+    Node* perfect(int levels)
+    {
+        if(levels == 0) return NULL;
+        Node* left = perfect(levels - 1);
+        Node* right = perfect(levels - 1);
+        return make(levels, left, right);
+    }
+
+    // a path of `length` nodes going left
+    Node* chain(size_t length)
+    {
+        Node* top = NULL;
+        for(size_t i = 0; i < length; ++i) {
+            top = make(static_cast<int>(i), top, NULL);
+        }
+        return top;
+    }
+
+private:
+    vector<Node> nodes_;
+};
+
+template<typename Check>
+void run(const string& label, Check check, Node* root, size_t nodes)
+{
+    chrono::steady_clock::time_point begin = chrono::steady_clock::now();
+    bool result = check(root);
+    chrono::steady_clock::time_point end = chrono::steady_clock::now();
+    double ms = chrono::duration<double, milli>(end - begin).count();
+    cout << left << setw(40) << label << right << fixed << setprecision(2)
+         << setw(10) << ms << " ms" << setw(8) << (result ? "equal" : "unequal")
+         << setw(10) << ms * 1e6 / nodes << " ns/node" << endl;
+}
+
+void runAll(const string& name, Node* root, size_t nodes, bool recursive)
+{
+    if(recursive) {
+        run(name + " recursive", equalPaths, root, nodes);
+    }
+    else {
+        cout << left << setw(40) << (name + " recursive") << "skipped (too deep for the call stack)" << endl;
+    }
+    run(name + " iterative", equalPathsIterative, root, nodes);
+    run(name + " parallel", [](Node* r) { return equalPathsParallel(r); }, root, nodes);
+}
+
+int main(int argc, char *argv[])
+{
+    int levels = argc > 1 ? atoi(argv[1]) : 21;
+    size_t chainLength = argc > 2 ? strtoull(argv[2], NULL, 10) : 5000000;
+    if(levels <= 0 || levels > 28 || chainLength == 0) {
+        cerr << "usage: " << argv[0] << " [levels (1-28)] [chain_length]" << endl;
+        return 1;
+    }
+    size_t perfectNodes = (size_t(1) << levels) - 1;
+
+    {
+        TreeBuilder trees(perfectNodes + 1);
+        Node* root = trees.perfect(levels);
+        runAll("perfect", root, perfectNodes, true);
+
+        // one extra leaf under the leftmost leaf: found in the first few leaves
+        Node* leftmost = root;
+        while(leftmost->left) leftmost = leftmost->left;
+        leftmost->left = trees.make(0);
+        runAll("perfect, leftmost leaf deeper", root, perfectNodes + 1, true);
+    }
+    {
+        TreeBuilder trees(chainLength);
+        runAll("chain", trees.chain(chainLength), chainLength, false);
+    }
+    return 0;
+}
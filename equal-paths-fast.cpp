@@ -0,0 +1,213 @@
+#include <atomic>
+#include <thread>
+#include <vector>
+#include <utility>
+#include "equal-paths-fast.h"
+using namespace std;
+
+// A node waiting to be visited, with its depth (the root is at depth 1).
+typedef pair<Node*, int> PendingNode;
+
+bool equalPathsIterative(Node *root) {
+  if (!root) {
+    return true;
+  }
+
+  int leafDepth = 0; // depth of the first leaf seen, 0 until then
+  vector<PendingNode> stack;
+  Node* node = root;
+  int depth = 1;
+  while (true) {
+    if (!node->left && !node->right) {
+      if (leafDepth == 0) {
+        leafDepth = depth;
+      }
+      else if (depth != leafDepth) {
+        return false; // no need to look any further
+      }
+      if (stack.empty()) {
+        return true;
+      }
+      node = stack.back().first;
+      depth = stack.back().second;
+      stack.pop_back();
+      continue;
+    }
+    // go down the left side right away, only the right side waits
+    ++depth;
+    if (node->left && node->right) {
+      stack.push_back(PendingNode(node->right, depth));
+    }
+    node = node->left ? node->left : node->right;
+  }
+}
+
+// State shared by the workers of equalPathsParallel.
+struct EqualPathsJob {
+  vector<PendingNode> subtrees;
+  atomic<size_t> nextSubtree;
+  atomic<int> leafDepth;   // 0 until some worker records the first leaf
+  atomic<bool> mismatch;
+
+  EqualPathsJob() : nextSubtree(0), leafDepth(0), mismatch(false) { }
+};
+
+// Records a leaf depth, returning false (and raising the flag) on a mismatch.
+static bool reportLeaf(EqualPathsJob& job, int depth) {
+  int expected = 0;
+  if (job.leafDepth.compare_exchange_strong(expected, depth) || expected == depth) {
+    return true;
+  }
+  job.mismatch.store(true, memory_order_relaxed);
+  return false;
+}
+
+// Claims subtrees until none are left or someone found a mismatch.
+static void equalPathsWorker(EqualPathsJob& job) {
+  // how many nodes to visit between looks at the cancellation flag
+  const unsigned int CHECK_EVERY = 1024;
+  vector<PendingNode> stack;
+  unsigned int sinceCheck = 0;
+
+  while (!job.mismatch.load(memory_order_relaxed)) {
+    size_t index = job.nextSubtree.fetch_add(1);
+    if (index >= job.subtrees.size()) {
+      return;
+    }
+    Node* node = job.subtrees[index].first;
+    int depth = job.subtrees[index].second;
+    while (true) {
+      if (++sinceCheck == CHECK_EVERY) {
+        sinceCheck = 0;
+        if (job.mismatch.load(memory_order_relaxed)) {
+          return;
+        }
+      }
+      if (!node->left && !node->right) {
+        if (!reportLeaf(job, depth)) {
+          return;
+        }
+        if (stack.empty()) {
+          break;
+        }
+        node = stack.back().first;
+        depth = stack.back().second;
+        stack.pop_back();
+        continue;
+      }
+      ++depth;
+      if (node->left && node->right) {
+        stack.push_back(PendingNode(node->right, depth));
+      }
+      node = node->left ? node->left : node->right;
+    }
+  }
+}
+
+bool equalPathsParallel(Node *root, unsigned int threads) {
+  if (!root) {
+    return true;
+  }
+  if (threads == 0) {
+    threads = thread::hardware_concurrency();
+  }
+  if (threads <= 1) {
+    return equalPathsIterative(root);
+  }
+
+  // Expand the top of the tree level by level until there are a few
+  // subtrees per thread to hand out (or the tree turns out to be a chain).
+  // Leaves met on the way are checked right here.
+  EqualPathsJob job;
+  const size_t WANTED = 8 * threads;
+  const int MAX_LEVELS = 64;
+  vector<PendingNode> level(1, PendingNode(root, 1));
+  for (int i = 0; i < MAX_LEVELS && !level.empty() && level.size() < WANTED; ++i) {
+    vector<PendingNode> below;
+    for (size_t j = 0; j < level.size(); ++j) {
+      Node* node = level[j].first;
+      int depth = level[j].second;
+      if (!node->left && !node->right) {
+        if (!reportLeaf(job, depth)) {
+          return false;
+        }
+        continue;
+      }
+      if (node->left) {
+        below.push_back(PendingNode(node->left, depth + 1));
+      }
+      if (node->right) {
+        below.push_back(PendingNode(node->right, depth + 1));
+      }
+    }
+    level.swap(below);
+  }
+  job.subtrees.swap(level);
+
+  vector<thread> workers;
+  for (unsigned int i = 1; i < threads; ++i) {
+    workers.push_back(thread(equalPathsWorker, ref(job)));
+  }
+  equalPathsWorker(job);
+  for (size_t i = 0; i < workers.size(); ++i) {
+    workers[i].join();
+  }
+  return !job.mismatch.load();
+}
+
+ShapeStats equalPathsShape(Node *root) {
+  ShapeStats stats;
+  // A visited node's right link may be one of our temporary back links,
+  // which only becomes clear on the next step, so its child count is
+  // settled one step late.
+  Node* pending = nullptr;
+  int pendingDepth = 0;
+  int pendingChildren = 0;
+
+  Node* curr = root;
+  int depth = 0;
+  while (curr) {
+    Node* pred = nullptr;
+    int steps = 0;
+    if (curr->left) {
+      pred = curr->left;
+      steps = 1;
+      while (pred->right && pred->right != curr) {
+        pred = pred->right;
+        ++steps;
+      }
+    }
+    bool backLink = pred && pred->right == curr;
+    if (pending) {
+      // we got to curr through pending's right link
+      stats.addNode(pendingDepth, pendingChildren + (backLink && pred == pending ? 0 : 1));
+      pending = nullptr;
+    }
+
+    if (pred && !backLink) {
+      // first visit: leave a way back up, then go left
+      pred->right = curr;
+      curr = curr->left;
+      ++depth;
+      continue;
+    }
+    if (backLink) {
+      pred->right = nullptr;
+      depth -= steps + 1;
+    }
+
+    // in-order visit of curr
+    int children = curr->left ? 1 : 0;
+    if (curr->right) {
+      pending = curr;
+      pendingDepth = depth;
+      pendingChildren = children;
+    }
+    else {
+      stats.addNode(depth, children);
+    }
+    curr = curr->right;
+    ++depth;
+  }
+  return stats;
+}
@@ -0,0 +1,38 @@
+#ifndef EQUAL_PATHS_FAST_H
+#define EQUAL_PATHS_FAST_H
+
+#include "equal-paths.h"
+#include "shape-stats.h"
+
+/**
+ * @brief Same answer as equalPaths(), but walks the tree with an explicit
+ *        stack (so deep chains cannot overflow the call stack) and returns
+ *        as soon as a leaf at a different depth than the first leaf shows up.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ */
+bool equalPathsIterative(Node * root);
+
+/**
+ * @brief Same answer as equalPaths(), checking disjoint subtrees on up to
+ *        `threads` threads (0 means one per core). The first thread to find
+ *        a mismatching leaf cancels all the others.
+ *
+ * @param root Pointer to the root of the tree to check for equal paths
+ * @param threads Number of threads to use, 0 for hardware concurrency
+ */
+bool equalPathsParallel(Node * root, unsigned int threads = 0);
+
+/**
+ * @brief Leaf-depth histogram, min/max/average depth, unary node count and
+ *        fullness of the tree, in one O(n) pass with O(1) extra space.
+ *
+ *        The walk is a Morris traversal: it temporarily points some right
+ *        links back up the tree and restores every one of them before it
+ *        returns, so nothing else may read the tree while it runs.
+ *
+ * @param root Pointer to the root of the tree to analyze
+ */
+ShapeStats equalPathsShape(Node * root);
+
+#endif
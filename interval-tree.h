@@ -0,0 +1,201 @@
+#ifndef INTERVAL_TREE_H
+#define INTERVAL_TREE_H
+
+#include <limits>
+#include <ostream>
+#include <utility>
+#include <vector>
+#include "augmented-avlbst.h"
+
+/**
+* A closed interval [start, end], the key of an IntervalTree. Ordered by
+* start, then end.
+*/
+template <class Point>
+struct Interval
+{
+    Interval() : start(), end() { }
+    Interval(const Point& s, const Point& e) : start(s), end(e) { }
+
+    bool overlaps(const Point& lo, const Point& hi) const { return !(hi < start) && !(end < lo); }
+
+    Point start;
+    Point end;
+};
+
+template <class Point>
+bool operator<(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return a.start < b.start || (!(b.start < a.start) && a.end < b.end);
+}
+
+template <class Point>
+bool operator>(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return b < a;
+}
+
+template <class Point>
+bool operator==(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return !(a < b) && !(b < a);
+}
+
+template <class Point>
+bool operator!=(const Interval<Point>& a, const Interval<Point>& b)
+{
+    return !(a == b);
+}
+
+template <class Point>
+std::ostream& operator<<(std::ostream& out, const Interval<Point>& interval)
+{
+    return out << '[' << interval.start << ", " << interval.end << ']';
+}
+
+/**
+* The largest end point in a subtree of intervals.
+*/
+template <class Point>
+struct IntervalEndMax
+{
+    static_assert(std::numeric_limits<Point>::is_specialized,
+        "IntervalTree needs numeric_limits<Point>::lowest() as the end of an empty subtree");
+    typedef Point type;
+    static Point identity() { return std::numeric_limits<Point>::lowest(); }
+    template<class Value>
+    static Point lift(const Interval<Point>& interval, const Value&) { return interval.end; }
+    static Point combine(const Point& a, const Point& b) { return a < b ? b : a; }
+};
+
+/**
+* Closed intervals [start, end] mapped to values, ordered by start, then
+* end, so several intervals may share a start. Every node knows the largest
+* end in its subtree, kept current through the AVL rotations by
+* AugmentedAVLTree, so overlap searches skip every subtree that ends
+* before the query and everything right of a start past it. A query
+* reporting k intervals visits O(min(n, (k + 1) log n)) nodes, O(log n)
+* when nothing matches.
+*/
+template <class Point, class Value = NoValue>
+class IntervalTree : protected AugmentedAVLTree<Interval<Point>, Value, IntervalEndMax<Point> >
+{
+    typedef AugmentedAVLTree<Interval<Point>, Value, IntervalEndMax<Point> > Base;
+    typedef AVLNode<Interval<Point>, Value> IntervalNode;
+
+public:
+    typedef typename Base::iterator iterator;
+
+    void insert(const Point& start, const Point& end, const Value& value = Value());
+    void remove(const Point& start, const Point& end);
+
+    template<class Visit>
+    void visitOverlaps(const Point& lo, const Point& hi, Visit visit) const;
+    size_t overlaps(const Point& lo, const Point& hi, std::vector<iterator>& out) const;
+    size_t stab(const Point& point, std::vector<iterator>& out) const;
+    bool anyOverlap(const Point& lo, const Point& hi) const;
+
+    using Base::assign;
+    using Base::erase;
+    using Base::clear;
+    using Base::empty;
+    using Base::begin;
+    using Base::end;
+    using Base::isBalanced;
+
+protected:
+    template<class Visit>
+    static void visitOverlaps(IntervalNode* node, const Point& lo, const Point& hi, Visit& visit);
+};
+
+/**
+* Adds [start, end], or replaces the value of an identical interval.
+*/
+template<class Point, class Value>
+void IntervalTree<Point, Value>::insert(const Point& start, const Point& end, const Value& value)
+{
+  Base::insert(std::make_pair(Interval<Point>(start, end), value));
+}
+
+template<class Point, class Value>
+void IntervalTree<Point, Value>::remove(const Point& start, const Point& end)
+{
+  Base::remove(Interval<Point>(start, end));
+}
+
+/**
+* Calls visit(it) for every interval that overlaps [lo, hi], in order.
+*/
+template<class Point, class Value>
+template<class Visit>
+void IntervalTree<Point, Value>::visitOverlaps(const Point& lo, const Point& hi, Visit visit) const
+{
+  visitOverlaps(static_cast<IntervalNode*>(this->root_), lo, hi, visit);
+}
+
+template<class Point, class Value>
+template<class Visit>
+void IntervalTree<Point, Value>::visitOverlaps(IntervalNode* node, const Point& lo, const Point& hi, Visit& visit)
+{
+  // recursion depth is the tree height, about 1.44 log2(n) at worst
+  while (node != nullptr && !(Base::summary(node) < lo)) {
+    visitOverlaps(node->getLeft(), lo, hi, visit);
+    const Interval<Point>& interval = node->getKey();
+    if (hi < interval.start) {
+      return; // it and everything right of it start too late
+    }
+    if (!(interval.end < lo)) {
+      visit(Base::iteratorAt(node));
+    }
+    node = node->getRight();
+  }
+}
+
+/**
+* Appends every interval overlapping [lo, hi] to out; returns how many.
+*/
+template<class Point, class Value>
+size_t IntervalTree<Point, Value>::overlaps(const Point& lo, const Point& hi, std::vector<iterator>& out) const
+{
+  size_t before = out.size();
+  visitOverlaps(lo, hi, [&out](const iterator& it) { out.push_back(it); });
+  return out.size() - before;
+}
+
+/**
+* Appends every interval containing point to out; returns how many.
+*/
+template<class Point, class Value>
+size_t IntervalTree<Point, Value>::stab(const Point& point, std::vector<iterator>& out) const
+{
+  return overlaps(point, point, out);
+}
+
+/**
+* Whether any interval overlaps [lo, hi]. Takes the leftmost branch that
+* can still hold one, so O(log n).
+*/
+template<class Point, class Value>
+bool IntervalTree<Point, Value>::anyOverlap(const Point& lo, const Point& hi) const
+{
+  IntervalNode* node = static_cast<IntervalNode*>(this->root_);
+  while (node != nullptr) {
+    const Interval<Point>& interval = node->getKey();
+    if (interval.overlaps(lo, hi)) {
+      return true;
+    }
+    IntervalNode* left = node->getLeft();
+    if (left != nullptr && !(Base::summary(left) < lo)) {
+      node = left;
+    }
+    else if (hi < interval.start) {
+      return false;
+    }
+    else {
+      node = node->getRight();
+    }
+  }
+  return false;
+}
+
+#endif
@@ -0,0 +1,214 @@
+#ifndef PERF_COUNTERS_H
+#define PERF_COUNTERS_H
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+ * A small wrapper around Linux perf_event_open for the benchmark driver.
+ * It opens one counter per hardware event for the calling thread and lets
+ * the caller bracket a region of code with start()/stop().
+ *
+ * Each event is opened on its own, so a machine that exposes cycles but not
+ * cache misses (common in VMs) still reports what it can.  When perf events
+ * are not permitted at all (perf_event_paranoid, containers, non-Linux),
+ * available() returns false and every counter reads as unavailable; the
+ * caller is expected to fall back to wall-clock numbers only.
+ */
+class PerfCounters
+{
+public:
+    enum Event {
+        INSTRUCTIONS = 0,
+        CYCLES,
+        BRANCH_MISSES,
+        CACHE_MISSES,
+        NUM_EVENTS
+    };
+
+    PerfCounters();
+    ~PerfCounters();
+
+    bool available() const;
+    bool available(Event e) const;
+    void start();
+    void stop();
+    bool get(Event e, uint64_t& count) const;
+    static const char* name(Event e);
+
+private:
+    // Not copyable: the object owns file descriptors.
+    PerfCounters(const PerfCounters&);
+    PerfCounters& operator=(const PerfCounters&);
+
+    bool readCounter(int fd, uint64_t values[3]) const;
+
+    int fds_[NUM_EVENTS];
+    // value, time enabled, time running as read by start(); the times are
+    // totals since the counter was opened, which a reset does not clear
+    uint64_t begin_[NUM_EVENTS][3];
+    uint64_t counts_[NUM_EVENTS];
+    bool ran_[NUM_EVENTS];
+};
+
+/**
+* Opens every counter we know about.  Failures are remembered per event
+* rather than reported, so construction never throws.
+*/
+inline PerfCounters::PerfCounters()
+{
+    for(int i = 0; i < NUM_EVENTS; ++i) {
+        fds_[i] = -1;
+        begin_[i][0] = begin_[i][1] = begin_[i][2] = 0;
+        counts_[i] = 0;
+        ran_[i] = false;
+    }
+#ifdef __linux__
+    static const uint64_t configs[NUM_EVENTS] = {
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_BRANCH_MISSES,
+        PERF_COUNT_HW_CACHE_MISSES
+    };
+    for(int i = 0; i < NUM_EVENTS; ++i) {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.size = sizeof(attr);
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.config = configs[i];
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        // scale for multiplexing when more events are open than there are PMU slots
+        attr.read_format = PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        fds_[i] = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+#endif
+}
+
+inline PerfCounters::~PerfCounters()
+{
+#ifdef __linux__
+    for(int i = 0; i < NUM_EVENTS; ++i) {
+        if(fds_[i] >= 0) {
+            close(fds_[i]);
+        }
+    }
+#endif
+}
+
+/**
+* Returns true if at least one counter could be opened.
+*/
+inline bool PerfCounters::available() const
+{
+    for(int i = 0; i < NUM_EVENTS; ++i) {
+        if(fds_[i] >= 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/**
+* Returns true if the given counter could be opened.
+*/
+inline bool PerfCounters::available(Event e) const
+{
+    return fds_[e] >= 0;
+}
+
+/**
+* Resets and enables all open counters, noting their enabled and running
+* times so that stop() can scale by what this region alone got.
+*/
+inline void PerfCounters::start()
+{
+#ifdef __linux__
+    for(int i = 0; i < NUM_EVENTS; ++i) {
+        if(fds_[i] >= 0) {
+            ioctl(fds_[i], PERF_EVENT_IOC_RESET, 0);
+            if(!readCounter(fds_[i], begin_[i])) {
+                begin_[i][0] = begin_[i][1] = begin_[i][2] = 0;
+            }
+            ioctl(fds_[i], PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+#endif
+}
+
+/**
+* Disables all open counters and latches their values for get(), each
+* scaled up if the kernel only had it scheduled for part of the time it
+* was enabled since start().
+*/
+inline void PerfCounters::stop()
+{
+#ifdef __linux__
+    for(int i = 0; i < NUM_EVENTS; ++i) {
+        counts_[i] = 0;
+        ran_[i] = false;
+        if(fds_[i] < 0) {
+            continue;
+        }
+        ioctl(fds_[i], PERF_EVENT_IOC_DISABLE, 0);
+        uint64_t end[3];
+        if(!readCounter(fds_[i], end)) {
+            continue;
+        }
+        uint64_t value = end[0] - begin_[i][0];
+        uint64_t enabled = end[1] - begin_[i][1];
+        uint64_t running = end[2] - begin_[i][2];
+        if(running == 0) {
+            continue; // never got scheduled on the PMU
+        }
+        ran_[i] = true;
+        counts_[i] = running < enabled
+            ? static_cast<uint64_t>(static_cast<double>(value) * enabled / running)
+            : value;
+    }
+#endif
+}
+
+/**
+* Sets count to the value latched by the last stop() and returns true, or
+* returns false if the counter is unavailable or never got scheduled
+* between start() and stop().
+*/
+inline bool PerfCounters::get(Event e, uint64_t& count) const
+{
+    count = counts_[e];
+    return ran_[e];
+}
+
+inline const char* PerfCounters::name(Event e)
+{
+    static const char* names[NUM_EVENTS] = {
+        "instructions", "cycles", "branch-misses", "cache-misses"
+    };
+    return names[e];
+}
+
+/**
+* Reads one counter's value and its total enabled and running times.
+*/
+inline bool PerfCounters::readCounter(int fd, uint64_t values[3]) const
+{
+#ifdef __linux__
+    return read(fd, values, 3 * sizeof(uint64_t)) == static_cast<ssize_t>(3 * sizeof(uint64_t));
+#else
+    (void)fd;
+    (void)values;
+    return false;
+#endif
+}
+
+#endif
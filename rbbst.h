@@ -0,0 +1,357 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <cstdint>
+#include "bst.h"
+
+/**
+* A node for a red-black tree: a plain Node plus one byte of color, the
+* same space AVLNode spends on its balance.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    enum Color { RED = 0, BLACK = 1 };
+
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    Color getColor() const;
+    void setColor(Color color);
+
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+
+protected:
+    uint8_t color_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* New nodes start out red.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), color_(RED)
+{
+
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+template<class Key, class Value>
+typename RBNode<Key, Value>::Color RBNode<Key, Value>::getColor() const
+{
+    return static_cast<Color>(color_);
+}
+
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(Color color)
+{
+    color_ = static_cast<uint8_t>(color);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+RBNode<Key, Value>* RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A red-black tree. Heights are within a factor of two of optimal, a bit
+* looser than AVL, but an insert does at most two rotations and a remove
+* at most three; everything else is recoloring. That makes it the better
+* pick for write-heavy use, AVL for read-heavy use.
+*/
+template <class Key, class Value>
+class RBTree : public BinarySearchTree<Key, Value>
+{
+public:
+    RBTree();
+    RBTree(const RBTree<Key, Value>& other);
+    RBTree(RBTree<Key, Value>&& other) noexcept;
+    RBTree<Key, Value>& operator=(const RBTree<Key, Value>& other);
+    RBTree<Key, Value>& operator=(RBTree<Key, Value>&& other) noexcept;
+
+    typedef NodeHandle<Key, Value, RBTree<Key, Value> > node_type;
+    node_type extract(const Key& key);
+    node_type extract(typename BinarySearchTree<Key, Value>::iterator pos);
+    typename BinarySearchTree<Key, Value>::iterator insert(node_type&& handle);
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+
+protected:
+    virtual void detachNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+        typename BinarySearchTree<Key, Value>::NodeDispose dispose);
+    static bool isRed(RBNode<Key, Value>* node);
+    void insertFix(RBNode<Key, Value>* node);
+    void removeFix(RBNode<Key, Value>* parent, bool leftShrank);
+};
+
+template<class Key, class Value>
+RBTree<Key, Value>::RBTree()
+{
+}
+
+/**
+* Copies other node for node, colors included, in O(n).
+*/
+template<class Key, class Value>
+RBTree<Key, Value>::RBTree(const RBTree<Key, Value>& other) : BinarySearchTree<Key, Value>()
+{
+  this->template cloneFrom<RBNode<Key, Value> >(other);
+}
+
+template<class Key, class Value>
+RBTree<Key, Value>::RBTree(RBTree<Key, Value>&& other) noexcept : BinarySearchTree<Key, Value>(std::move(other))
+{
+}
+
+template<class Key, class Value>
+RBTree<Key, Value>& RBTree<Key, Value>::operator=(const RBTree<Key, Value>& other)
+{
+  if (this != &other) {
+    this->clear();
+    this->template cloneFrom<RBNode<Key, Value> >(other);
+  }
+  return *this;
+}
+
+template<class Key, class Value>
+RBTree<Key, Value>& RBTree<Key, Value>::operator=(RBTree<Key, Value>&& other) noexcept
+{
+  BinarySearchTree<Key, Value>::operator=(std::move(other));
+  return *this;
+}
+
+/**
+* Missing children count as black.
+*/
+template<class Key, class Value>
+bool RBTree<Key, Value>::isRed(RBNode<Key, Value>* node)
+{
+  return node != nullptr && node->getColor() == RBNode<Key, Value>::RED;
+}
+
+template<class Key, class Value>
+void RBTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+  RBNode<Key, Value>* parent = nullptr;
+  RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(this->root_);
+  while (node != nullptr) {
+    if (new_item.first < node->getKey()) {
+      parent = node;
+      node = node->getLeft();
+    }
+    else if (node->getKey() < new_item.first) {
+      parent = node;
+      node = node->getRight();
+    }
+    else {
+      node->setValue(new_item.second);
+      return;
+    }
+  }
+
+  node = new RBNode<Key, Value>(new_item.first, new_item.second, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+  }
+  else if (new_item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  insertFix(node);
+}
+
+/**
+* As BinarySearchTree's, but with handles only a RBTree takes back.
+*/
+template<class Key, class Value>
+typename RBTree<Key, Value>::node_type RBTree<Key, Value>::extract(const Key& key)
+{
+  return this->template extractKey<node_type>(key);
+}
+
+template<class Key, class Value>
+typename RBTree<Key, Value>::node_type RBTree<Key, Value>::extract(typename BinarySearchTree<Key, Value>::iterator pos)
+{
+  return this->template extractAt<node_type>(pos);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator RBTree<Key, Value>::insert(node_type&& handle)
+{
+  return this->insertHandle(std::move(handle));
+}
+
+/**
+* Links a node extracted from another RBTree as a fresh red leaf.
+*/
+template<class Key, class Value>
+Node<Key, Value>* RBTree<Key, Value>::attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+    typename BinarySearchTree<Key, Value>::NodeDispose dispose)
+{
+  (void)storage;
+  (void)dispose;
+  Node<Key, Value>* at = this->placeLeaf(node);
+  if (at == node) {
+    RBNode<Key, Value>* leaf = static_cast<RBNode<Key, Value>*>(node);
+    leaf->setColor(RBNode<Key, Value>::RED);
+    insertFix(leaf);
+  }
+  return at;
+}
+
+/**
+* Repairs a red node with a red parent. A red uncle is pushed up by
+* recoloring; otherwise one or two rotations finish the job.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::insertFix(RBNode<Key, Value>* node)
+{
+  while (isRed(node->getParent())) {
+    RBNode<Key, Value>* parent = node->getParent();
+    RBNode<Key, Value>* grand = parent->getParent(); // a red node is never the root
+    bool parentLeft = (parent == grand->getLeft());
+    RBNode<Key, Value>* uncle = parentLeft ? grand->getRight() : grand->getLeft();
+
+    if (isRed(uncle)) {
+      parent->setColor(RBNode<Key, Value>::BLACK);
+      uncle->setColor(RBNode<Key, Value>::BLACK);
+      grand->setColor(RBNode<Key, Value>::RED);
+      node = grand;
+      continue;
+    }
+
+    if (parentLeft) {
+      if (node == parent->getRight()) {
+        this->rotateLeft(parent);
+        parent = node;
+      }
+      this->rotateRight(grand);
+    }
+    else {
+      if (node == parent->getLeft()) {
+        this->rotateRight(parent);
+        parent = node;
+      }
+      this->rotateLeft(grand);
+    }
+    parent->setColor(RBNode<Key, Value>::BLACK);
+    grand->setColor(RBNode<Key, Value>::RED);
+    break;
+  }
+  static_cast<RBNode<Key, Value>*>(this->root_)->setColor(RBNode<Key, Value>::BLACK);
+}
+
+/**
+* Splices node out with BinarySearchTree::spliceOut(); a predecessor moved
+* into its place takes its color, so the color that really disappears is
+* the predecessor's, from the predecessor's old spot.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::detachNode(Node<Key, Value>* victim)
+{
+  RBNode<Key, Value>* node = static_cast<RBNode<Key, Value>*>(victim);
+  this->unlinkInOrder(node);
+
+  typename RBNode<Key, Value>::Color removed = node->getColor();
+  RBNode<Key, Value>* heir = nullptr;
+  if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+    heir = static_cast<RBNode<Key, Value>*>(this->predecessor(node));
+    removed = heir->getColor();
+  }
+  bool leftShrank;
+  RBNode<Key, Value>* parent = static_cast<RBNode<Key, Value>*>(this->spliceOut(node, leftShrank));
+  if (heir != nullptr) {
+    heir->setColor(node->getColor());
+  }
+
+  if (removed == RBNode<Key, Value>::BLACK) {
+    removeFix(parent, leftShrank);
+  }
+}
+
+/**
+* The left (leftShrank) or right subtree of parent is one black short.
+* A red root of it simply turns black; otherwise a red is borrowed from
+* the sibling's side with at most three rotations, or the shortage is
+* pushed up by recoloring.
+*/
+template<class Key, class Value>
+void RBTree<Key, Value>::removeFix(RBNode<Key, Value>* parent, bool leftShrank)
+{
+  RBNode<Key, Value>* node = parent == nullptr ? static_cast<RBNode<Key, Value>*>(this->root_)
+    : (leftShrank ? parent->getLeft() : parent->getRight());
+  while (parent != nullptr && !isRed(node)) {
+    RBNode<Key, Value>* sibling = leftShrank ? parent->getRight() : parent->getLeft();
+
+    if (isRed(sibling)) {
+      sibling->setColor(RBNode<Key, Value>::BLACK);
+      parent->setColor(RBNode<Key, Value>::RED);
+      leftShrank ? this->rotateLeft(parent) : this->rotateRight(parent);
+      sibling = leftShrank ? parent->getRight() : parent->getLeft();
+    }
+
+    RBNode<Key, Value>* near = leftShrank ? sibling->getLeft() : sibling->getRight();
+    RBNode<Key, Value>* far = leftShrank ? sibling->getRight() : sibling->getLeft();
+    if (!isRed(near) && !isRed(far)) {
+      sibling->setColor(RBNode<Key, Value>::RED);
+      node = parent;
+      parent = node->getParent();
+      leftShrank = (parent != nullptr && node == parent->getLeft());
+      continue;
+    }
+
+    if (!isRed(far)) {
+      near->setColor(RBNode<Key, Value>::BLACK);
+      sibling->setColor(RBNode<Key, Value>::RED);
+      leftShrank ? this->rotateRight(sibling) : this->rotateLeft(sibling);
+      sibling = near;
+      far = leftShrank ? sibling->getRight() : sibling->getLeft();
+    }
+    sibling->setColor(parent->getColor());
+    parent->setColor(RBNode<Key, Value>::BLACK);
+    far->setColor(RBNode<Key, Value>::BLACK);
+    leftShrank ? this->rotateLeft(parent) : this->rotateRight(parent);
+    return;
+  }
+  if (node != nullptr) {
+    node->setColor(RBNode<Key, Value>::BLACK);
+  }
+}
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef SHAPE_STATS_H
+#define SHAPE_STATS_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cmath>
+
+/**
+ * Shape statistics of a binary tree, filled in by a single traversal (see
+ * BinarySearchTree::shapeStats() and equalPathsShape()). Depths count
+ * edges from the root, so the root is at depth 0.
+ *
+ * Everything is kept in fixed-size fields so collecting the statistics
+ * never allocates; leaf depths of LEAF_BUCKETS - 1 and more share the
+ * last histogram bucket.
+ */
+struct ShapeStats
+{
+    static const int LEAF_BUCKETS = 64;
+
+    size_t nodes;
+    size_t leaves;
+    size_t unaryNodes;      // exactly one child
+    size_t fullNodes;       // two children
+    int minLeafDepth;       // -1 for an empty tree
+    int maxLeafDepth;       // the height; -1 for an empty tree
+    uint64_t leafDepthSum;
+    uint64_t nodeDepthSum;  // the internal path length
+    size_t leafDepthHistogram[LEAF_BUCKETS];
+
+    ShapeStats();
+
+    void addNode(int depth, int children);
+
+    int height() const { return maxLeafDepth; }
+    bool equalPaths() const { return minLeafDepth == maxLeafDepth; }
+    double averageLeafDepth() const;
+    double averageNodeDepth() const;
+    double fullness() const;
+};
+
+inline ShapeStats::ShapeStats() :
+    nodes(0), leaves(0), unaryNodes(0), fullNodes(0),
+    minLeafDepth(-1), maxLeafDepth(-1), leafDepthSum(0), nodeDepthSum(0)
+{
+    for(int i = 0; i < LEAF_BUCKETS; ++i) {
+        leafDepthHistogram[i] = 0;
+    }
+}
+
+/**
+* Records one node with the given depth and number of children.
+*/
+inline void ShapeStats::addNode(int depth, int children)
+{
+    ++nodes;
+    nodeDepthSum += depth;
+    if(children == 2) {
+        ++fullNodes;
+        return;
+    }
+    if(children == 1) {
+        ++unaryNodes;
+        return;
+    }
+    ++leaves;
+    leafDepthSum += depth;
+    if(minLeafDepth < 0 || depth < minLeafDepth) minLeafDepth = depth;
+    if(depth > maxLeafDepth) maxLeafDepth = depth;
+    ++leafDepthHistogram[depth < LEAF_BUCKETS - 1 ? depth : LEAF_BUCKETS - 1];
+}
+
+inline double ShapeStats::averageLeafDepth() const
+{
+    return leaves == 0 ? 0.0 : static_cast<double>(leafDepthSum) / leaves;
+}
+
+/**
+* The average number of edges followed by a successful search.
+*/
+inline double ShapeStats::averageNodeDepth() const
+{
+    return nodes == 0 ? 0.0 : static_cast<double>(nodeDepthSum) / nodes;
+}
+
+/**
+* How much of a perfect tree of the same height is occupied: 1 for a
+* perfect tree, down to about n / 2^n for a chain. An empty tree counts
+* as full.
+*/
+inline double ShapeStats::fullness() const
+{
+    if(nodes == 0) {
+        return 1.0;
+    }
+    return static_cast<double>(nodes) / (std::ldexp(1.0, maxLeafDepth + 1) - 1.0);
+}
+
+#endif
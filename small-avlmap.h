@@ -0,0 +1,470 @@
+#ifndef SMALL_AVLMAP_H
+#define SMALL_AVLMAP_H
+
+#include <cstddef>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* A map with BinarySearchTree's interface for the common case of a handful
+* of entries. Up to N entries live inline in a sorted array inside the map
+* object: no allocation, no pointers, one or two cache lines to search.
+* Inserting past N moves them into an AVLTree (promote, O(N)); removing
+* down to N / 2 moves them back (demote). The gap between the two
+* thresholds keeps a map that hovers around N from converting on every
+* call.
+*
+* Iterators are invalidated by every insert and remove while inline, and
+* by any promote or demote.
+*
+* Inline inserts and removes shift entries with move assignment, so with
+* keys and values whose moves do not throw (std::string among them) a
+* throwing copy of the new entry leaves the map as it was.
+*/
+template <class Key, class Value, size_t N = 16>
+class SmallAVLMap
+{
+    static_assert(N > 0, "SmallAVLMap needs room for at least one inline entry");
+
+    typedef std::pair<const Key, Value> Item;     // what insert() takes and tree nodes hold
+    typedef std::pair<Key, Value> Entry;          // what a slot holds: assignable, so entries can shift
+    typedef typename std::aligned_storage<sizeof(Entry), alignof(Entry)>::type Slot;
+
+    /**
+    * The AVLTree a promoted map lives in, plus what the map needs beyond
+    * its public interface: an insert that reports whether the key was new
+    * in a single descent, and a build from entries already sorted and
+    * distinct.
+    */
+    class Tree : public AVLTree<Key, Value>
+    {
+    public:
+        bool insertNew(const Item& item);
+        void buildSorted(const std::vector<Entry>& items);
+    };
+
+public:
+    /**
+    * What an iterator refers to: the key read-only, the value writable.
+    * A view rather than an Item&, since inline slots hold pair<Key, Value>.
+    */
+    typedef std::pair<const Key&, Value&> reference;
+
+    class iterator
+    {
+    public:
+        class pointer
+        {
+        public:
+            explicit pointer(const reference& ref) : ref_(ref) { }
+            const reference* operator->() const { return &ref_; }
+
+        private:
+            reference ref_;
+        };
+
+        iterator() : slot_(NULL), last_(NULL), node_() { }
+
+        reference operator*() const
+        {
+            return slot_ ? reference(slot_->first, slot_->second) : reference(node_->first, node_->second);
+        }
+        pointer operator->() const { return pointer(**this); }
+        bool operator==(const iterator& rhs) const { return slot_ == rhs.slot_ && node_ == rhs.node_; }
+        bool operator!=(const iterator& rhs) const { return !(*this == rhs); }
+        iterator& operator++();
+
+    protected:
+        friend class SmallAVLMap<Key, Value, N>;
+        iterator(Entry* slot, Entry* last) : slot_(slot), last_(last), node_() { }
+        iterator(typename Tree::iterator node) : slot_(NULL), last_(NULL), node_(node) { }
+
+        Entry* slot_;   // inline mode: the entry, or NULL at the end
+        Entry* last_;
+        typename Tree::iterator node_;
+    };
+
+    SmallAVLMap();
+    SmallAVLMap(const SmallAVLMap<Key, Value, N>& other);
+    SmallAVLMap(SmallAVLMap<Key, Value, N>&& other) noexcept(std::is_nothrow_move_constructible<Entry>::value);
+    SmallAVLMap<Key, Value, N>& operator=(const SmallAVLMap<Key, Value, N>& other);
+    SmallAVLMap<Key, Value, N>& operator=(SmallAVLMap<Key, Value, N>&& other)
+        noexcept(std::is_nothrow_move_constructible<Entry>::value);
+    ~SmallAVLMap();
+
+    void insert(const std::pair<const Key, Value>& item);
+    void remove(const Key& key);
+    void clear();
+
+    bool empty() const { return size_ == 0; }
+    size_t size() const { return size_; }
+    bool isInline() const { return inline_; }
+    bool isBalanced() const { return inline_ || tree_.isBalanced(); }
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    Entry* entry(size_t i) const;
+    size_t lowerBound(const Key& key) const;
+    void promote(const Item& item, size_t pos);
+    void demote();
+    void destroySlots();
+    void copyFrom(const SmallAVLMap<Key, Value, N>& other);
+    void moveFrom(SmallAVLMap<Key, Value, N>& other);
+
+    Slot slots_[N];
+    size_t size_;
+    bool inline_;
+    Tree tree_;     // empty while inline
+};
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator& SmallAVLMap<Key, Value, N>::iterator::operator++()
+{
+    if(slot_) {
+        slot_ = (slot_ == last_) ? NULL : slot_ + 1;
+    }
+    else {
+        ++node_;
+    }
+    return *this;
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::SmallAVLMap() : size_(0), inline_(true)
+{
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::SmallAVLMap(const SmallAVLMap<Key, Value, N>& other) : size_(0), inline_(true)
+{
+  copyFrom(other);
+}
+
+/**
+* A promoted map hands over its tree in O(1); inline entries are moved
+* one by one.
+*/
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::SmallAVLMap(SmallAVLMap<Key, Value, N>&& other)
+    noexcept(std::is_nothrow_move_constructible<Entry>::value) : size_(0), inline_(true)
+{
+  moveFrom(other);
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>& SmallAVLMap<Key, Value, N>::operator=(const SmallAVLMap<Key, Value, N>& other)
+{
+  if (this != &other) {
+    clear();
+    copyFrom(other);
+  }
+  return *this;
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>& SmallAVLMap<Key, Value, N>::operator=(SmallAVLMap<Key, Value, N>&& other)
+    noexcept(std::is_nothrow_move_constructible<Entry>::value)
+{
+  if (this != &other) {
+    clear();
+    moveFrom(other);
+  }
+  return *this;
+}
+
+template<class Key, class Value, size_t N>
+SmallAVLMap<Key, Value, N>::~SmallAVLMap()
+{
+  clear();
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::Entry* SmallAVLMap<Key, Value, N>::entry(size_t i) const
+{
+  return reinterpret_cast<Entry*>(const_cast<Slot*>(&slots_[i]));
+}
+
+/**
+* Index of the first inline key not less than key. Counts the smaller keys
+* instead of stopping at the first larger one: for at most N entries the
+* loop has no data-dependent exit, and arithmetic keys vectorize.
+*/
+template<class Key, class Value, size_t N>
+size_t SmallAVLMap<Key, Value, N>::lowerBound(const Key& key) const
+{
+  size_t pos = 0;
+  for (size_t i = 0; i < size_; ++i) {
+    pos += (entry(i)->first < key);
+  }
+  return pos;
+}
+
+/**
+* Overwrites the value if key is present, as BinarySearchTree::insert does.
+* The new entry is built before any slot moves, and the shift only move-
+* assigns entries that are already alive.
+*/
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::insert(const std::pair<const Key, Value>& item)
+{
+  if (!inline_) {
+    if (tree_.insertNew(item)) {
+      ++size_;
+    }
+    return;
+  }
+
+  size_t pos = lowerBound(item.first);
+  if (pos < size_ && !(item.first < entry(pos)->first)) {
+    entry(pos)->second = item.second;
+    return;
+  }
+  if (size_ == N) {
+    promote(item, pos);
+    return;
+  }
+  if (pos == size_) {
+    new (entry(size_)) Entry(item.first, item.second);
+    ++size_;
+    return;
+  }
+  Entry fresh(item.first, item.second);
+  new (entry(size_)) Entry(std::move(*entry(size_ - 1)));
+  ++size_;
+  for (size_t i = size_ - 2; i > pos; --i) {
+    *entry(i) = std::move(*entry(i - 1));
+  }
+  *entry(pos) = std::move(fresh);
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::remove(const Key& key)
+{
+  if (!inline_) {
+    if (!tree_.extract(key)) {
+      return;
+    }
+    if (--size_ <= N / 2) {
+      demote();
+    }
+    return;
+  }
+
+  size_t pos = lowerBound(key);
+  if (pos == size_ || key < entry(pos)->first) {
+    return;
+  }
+  for (size_t i = pos; i + 1 < size_; ++i) {
+    *entry(i) = std::move(*entry(i + 1));
+  }
+  entry(--size_)->~Entry();
+}
+
+/**
+* Moves the N inline entries plus item (which belongs at pos) into the
+* tree. They are already sorted and distinct, so the tree is built
+* bottom-up in O(N) without sorting them again.
+*/
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::promote(const Item& item, size_t pos)
+{
+  std::vector<Entry> items;
+  items.reserve(size_ + 1);
+  for (size_t i = 0; i < size_; ++i) {
+    if (i == pos) {
+      items.push_back(Entry(item.first, item.second));
+    }
+    items.push_back(*entry(i));
+  }
+  if (pos == size_) {
+    items.push_back(Entry(item.first, item.second));
+  }
+  tree_.buildSorted(items);
+  destroySlots();
+  size_ = N + 1;
+  inline_ = false;
+}
+
+/**
+* Copies the entries back inline, then drops the tree. If one fails to
+* copy, the ones already built are destroyed and the map stays promoted
+* with the tree untouched.
+*/
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::demote()
+{
+  size_t built = 0;
+  try {
+    for (typename Tree::iterator it = tree_.begin(); it != tree_.end(); ++it, ++built) {
+      new (entry(built)) Entry(it->first, it->second);
+    }
+  }
+  catch (...) {
+    while (built > 0) {
+      entry(--built)->~Entry();
+    }
+    throw;
+  }
+  tree_.clear();
+  inline_ = true;
+}
+
+/**
+* Destroys the inline entries; size_ is left for the caller to set.
+*/
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::destroySlots()
+{
+  for (size_t i = 0; i < size_; ++i) {
+    entry(i)->~Entry();
+  }
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::clear()
+{
+  if (inline_) {
+    destroySlots();
+  }
+  else {
+    tree_.clear();
+  }
+  size_ = 0;
+  inline_ = true;
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::copyFrom(const SmallAVLMap<Key, Value, N>& other)
+{
+  if (other.inline_) {
+    for (; size_ < other.size_; ++size_) {
+      new (entry(size_)) Entry(*other.entry(size_));
+    }
+  }
+  else {
+    tree_ = other.tree_;
+    inline_ = false;
+    size_ = other.size_;
+  }
+}
+
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::moveFrom(SmallAVLMap<Key, Value, N>& other)
+{
+  if (other.inline_) {
+    for (; size_ < other.size_; ++size_) {
+      new (entry(size_)) Entry(std::move(*other.entry(size_)));
+    }
+  }
+  else {
+    tree_ = std::move(other.tree_);
+    inline_ = false;
+    size_ = other.size_;
+  }
+  other.clear();
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::begin() const
+{
+  if (!inline_) {
+    return iterator(tree_.begin());
+  }
+  return size_ == 0 ? end() : iterator(entry(0), entry(size_ - 1));
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::end() const
+{
+  return inline_ ? iterator(NULL, NULL) : iterator(tree_.end());
+}
+
+template<class Key, class Value, size_t N>
+typename SmallAVLMap<Key, Value, N>::iterator SmallAVLMap<Key, Value, N>::find(const Key& key) const
+{
+  if (!inline_) {
+    return iterator(tree_.find(key));
+  }
+  size_t pos = lowerBound(key);
+  if (pos == size_ || key < entry(pos)->first) {
+    return end();
+  }
+  return iterator(entry(pos), entry(size_ - 1));
+}
+
+template<class Key, class Value, size_t N>
+Value& SmallAVLMap<Key, Value, N>::operator[](const Key& key)
+{
+  iterator it = find(key);
+  if (it == end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+
+template<class Key, class Value, size_t N>
+Value const & SmallAVLMap<Key, Value, N>::operator[](const Key& key) const
+{
+  iterator it = find(key);
+  if (it == end()) throw std::out_of_range("Invalid key");
+  return it->second;
+}
+
+/**
+* Adds item and returns true, or overwrites the value of its key and
+* returns false, in one descent.
+*/
+template<class Key, class Value, size_t N>
+bool SmallAVLMap<Key, Value, N>::Tree::insertNew(const Item& item)
+{
+  AVLNode<Key, Value>* parent = nullptr;
+  AVLNode<Key, Value>* node = static_cast<AVLNode<Key, Value>*>(this->root_);
+  while (node != nullptr) {
+    parent = node;
+    if (item.first < node->getKey()) {
+      node = node->getLeft();
+    }
+    else if (node->getKey() < item.first) {
+      node = node->getRight();
+    }
+    else {
+      node->setValue(item.second);
+      return false;
+    }
+  }
+
+  node = new AVLNode<Key, Value>(item.first, item.second, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+    return true;
+  }
+  if (item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  this->insertFix(parent, node);
+  return true;
+}
+
+/**
+* Replaces the contents with items, which must be sorted by key with no
+* key twice: AVLTree::build without the sort and duplicate pass.
+*/
+template<class Key, class Value, size_t N>
+void SmallAVLMap<Key, Value, N>::Tree::buildSorted(const std::vector<Entry>& items)
+{
+  this->clear();
+  this->root_ = this->buildSubtree(items, 0, items.size(), 0);
+}
+
+#endif
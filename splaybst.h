@@ -0,0 +1,289 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <stdexcept>
+#include "bst.h"
+
+/**
+* A self-adjusting binary search tree. Every access rotates the node it
+* touched up to the root (splaying), so keys that are used often stay near
+* the top and a skewed workload costs far less than log n per operation.
+* Any sequence of operations is O(log n) amortized each.
+*
+* Splaying turns reads into writes. Two knobs trade some of the
+* self-adjustment for fewer of them on lookups:
+*  - splayEvery: find() and operator[] only splay every k-th lookup
+*    (inserts and removes always splay). A lookup that misses splays the
+*    last node it visited, so a run of misses reshapes the tree too.
+*  - semiSplay: in the zig-zig case only the upper rotation is done and
+*    splaying continues from the parent, which halves the depth of the
+*    access path while moving the accessed node only partway up.
+*
+* Plain BST nodes are used; there is no per-node bookkeeping. The
+* successor links are untouched by rotations, so iterators stay valid
+* across splays.
+*/
+template <class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value>
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    explicit SplayTree(unsigned int splayEvery = 1, bool semiSplay = false);
+    SplayTree(const SplayTree<Key, Value>& other);
+    SplayTree(SplayTree<Key, Value>&& other) noexcept;
+    SplayTree<Key, Value>& operator=(const SplayTree<Key, Value>& other);
+    SplayTree<Key, Value>& operator=(SplayTree<Key, Value>&& other) noexcept;
+    void swap(SplayTree<Key, Value>& other) noexcept;
+
+    typedef NodeHandle<Key, Value, SplayTree<Key, Value> > node_type;
+    node_type extract(const Key& key);
+    node_type extract(typename BinarySearchTree<Key, Value>::iterator pos);
+    typename BinarySearchTree<Key, Value>::iterator insert(node_type&& handle);
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+
+    // const lookups leave the shape alone; non-const ones splay
+    using BinarySearchTree<Key, Value>::find;
+    using BinarySearchTree<Key, Value>::operator[];
+    iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+protected:
+    virtual void detachNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+        typename BinarySearchTree<Key, Value>::NodeDispose dispose);
+    virtual void eraseNodes(const std::vector<Node<Key, Value>*>& doomed, size_t total);
+    void splay(Node<Key, Value>* node);
+    void accessed(Node<Key, Value>* node);
+
+private:
+    unsigned int splayEvery_;
+    unsigned int accesses_;
+    bool semiSplay_;
+};
+
+/**
+* splayEvery == 0 is treated as 1.
+*/
+template<class Key, class Value>
+SplayTree<Key, Value>::SplayTree(unsigned int splayEvery, bool semiSplay) :
+    splayEvery_(splayEvery == 0 ? 1 : splayEvery), accesses_(0), semiSplay_(semiSplay)
+{
+}
+
+/**
+* Copies other's current shape and its splaying settings in O(n).
+*/
+template<class Key, class Value>
+SplayTree<Key, Value>::SplayTree(const SplayTree<Key, Value>& other) :
+    BinarySearchTree<Key, Value>(other),
+    splayEvery_(other.splayEvery_), accesses_(other.accesses_), semiSplay_(other.semiSplay_)
+{
+}
+
+template<class Key, class Value>
+SplayTree<Key, Value>::SplayTree(SplayTree<Key, Value>&& other) noexcept :
+    BinarySearchTree<Key, Value>(std::move(other)),
+    splayEvery_(other.splayEvery_), accesses_(other.accesses_), semiSplay_(other.semiSplay_)
+{
+}
+
+template<class Key, class Value>
+SplayTree<Key, Value>& SplayTree<Key, Value>::operator=(const SplayTree<Key, Value>& other)
+{
+  BinarySearchTree<Key, Value>::operator=(other);
+  splayEvery_ = other.splayEvery_;
+  accesses_ = other.accesses_;
+  semiSplay_ = other.semiSplay_;
+  return *this;
+}
+
+template<class Key, class Value>
+SplayTree<Key, Value>& SplayTree<Key, Value>::operator=(SplayTree<Key, Value>&& other) noexcept
+{
+  BinarySearchTree<Key, Value>::operator=(std::move(other));
+  splayEvery_ = other.splayEvery_;
+  accesses_ = other.accesses_;
+  semiSplay_ = other.semiSplay_;
+  return *this;
+}
+
+template<class Key, class Value>
+void SplayTree<Key, Value>::swap(SplayTree<Key, Value>& other) noexcept
+{
+  BinarySearchTree<Key, Value>::swap(other);
+  std::swap(splayEvery_, other.splayEvery_);
+  std::swap(accesses_, other.accesses_);
+  std::swap(semiSplay_, other.semiSplay_);
+}
+
+/**
+* Moves node up towards the root with zig / zig-zig / zig-zag steps.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::splay(Node<Key, Value>* node)
+{
+  while (node->getParent() != nullptr) {
+    Node<Key, Value>* parent = node->getParent();
+    Node<Key, Value>* grand = parent->getParent();
+    bool nodeLeft = (node == parent->getLeft());
+
+    if (grand == nullptr) { // zig
+      nodeLeft ? this->rotateRight(parent) : this->rotateLeft(parent);
+      return;
+    }
+
+    bool parentLeft = (parent == grand->getLeft());
+    if (nodeLeft == parentLeft) { // zig-zig
+      parentLeft ? this->rotateRight(grand) : this->rotateLeft(grand);
+      if (semiSplay_) {
+        node = parent;
+        continue;
+      }
+      nodeLeft ? this->rotateRight(parent) : this->rotateLeft(parent);
+    }
+    else { // zig-zag
+      nodeLeft ? this->rotateRight(parent) : this->rotateLeft(parent);
+      parentLeft ? this->rotateRight(grand) : this->rotateLeft(grand);
+    }
+  }
+}
+
+/**
+* Splays after a lookup, subject to splayEvery.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::accessed(Node<Key, Value>* node)
+{
+  if (++accesses_ >= splayEvery_) {
+    accesses_ = 0;
+    splay(node);
+  }
+}
+
+/**
+* Inserts (or overwrites) like BinarySearchTree::insert and splays the
+* entry to the root.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+  Node<Key, Value>* parent = nullptr;
+  Node<Key, Value>* curr = this->root_;
+  while (curr != nullptr) {
+    if (new_item.first == curr->getKey()) {
+      curr->setValue(new_item.second);
+      splay(curr);
+      return;
+    }
+    parent = curr;
+    curr = (new_item.first < curr->getKey()) ? curr->getLeft() : curr->getRight();
+  }
+
+  Node<Key, Value>* node = new Node<Key, Value>(new_item.first, new_item.second, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+  }
+  else if (new_item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  splay(node);
+}
+
+/**
+* Unhooks node and splays the node it was spliced out from.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::detachNode(Node<Key, Value>* node)
+{
+  this->unlinkInOrder(node);
+  bool leftShrank;
+  Node<Key, Value>* parent = this->spliceOut(node, leftShrank);
+  if (parent != nullptr) {
+    splay(parent);
+  }
+}
+
+/**
+* As BinarySearchTree's, but with handles only a SplayTree takes back.
+*/
+template<class Key, class Value>
+typename SplayTree<Key, Value>::node_type SplayTree<Key, Value>::extract(const Key& key)
+{
+  return this->template extractKey<node_type>(key);
+}
+
+template<class Key, class Value>
+typename SplayTree<Key, Value>::node_type SplayTree<Key, Value>::extract(typename BinarySearchTree<Key, Value>::iterator pos)
+{
+  return this->template extractAt<node_type>(pos);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator SplayTree<Key, Value>::insert(node_type&& handle)
+{
+  return this->insertHandle(std::move(handle));
+}
+
+/**
+* Links an extracted node and splays it (or the entry already holding its
+* key) to the root, as insert() does.
+*/
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+    typename BinarySearchTree<Key, Value>::NodeDispose dispose)
+{
+  (void)storage;
+  (void)dispose;
+  Node<Key, Value>* at = this->placeLeaf(node);
+  splay(at);
+  return at;
+}
+
+/**
+* A bulk eraseIf() says nothing about what will be looked up next, so the
+* victims are spliced out without splaying.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::eraseNodes(const std::vector<Node<Key, Value>*>& doomed, size_t total)
+{
+  (void)total;
+  for (size_t i = 0; i < doomed.size(); ++i) {
+    this->removeNode(doomed[i]);
+  }
+}
+
+/**
+* Splays the node found or, on a miss, the last node on the search path
+* (subject to splayEvery either way), so that a deep miss pays for itself.
+*/
+template<class Key, class Value>
+typename SplayTree<Key, Value>::iterator SplayTree<Key, Value>::find(const Key& key)
+{
+  Node<Key, Value>* last;
+  Node<Key, Value>* node = this->internalFind(key, last);
+  if (last != nullptr) {
+    accessed(last);
+  }
+  return this->iteratorAt(node);
+}
+
+template<class Key, class Value>
+Value& SplayTree<Key, Value>::operator[](const Key& key)
+{
+  Node<Key, Value>* last;
+  Node<Key, Value>* node = this->internalFind(key, last);
+  if (last != nullptr) {
+    accessed(last);
+  }
+  if (node == nullptr) {
+    throw std::out_of_range("Invalid key");
+  }
+  return node->getValue();
+}
+
+#endif
@@ -0,0 +1,272 @@
+#ifndef STRING_AVLBST_H
+#define STRING_AVLBST_H
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include "avlbst.h"
+
+/**
+* A string key that takes one pointer in the node: the length and the bytes
+* live together in a single heap block, where a std::string spends 32 bytes
+* in the node and still allocates once it outgrows its small buffer.
+* Ordered bytewise (unsigned), as std::string is. At most 4 GiB long.
+*/
+class PackedString
+{
+public:
+    PackedString() : rep_(nullptr) { }
+    PackedString(const char* data, size_t size) : rep_(pack(data, size)) { }
+    explicit PackedString(const std::string& s) : rep_(pack(s.data(), s.size())) { }
+    PackedString(const PackedString& other) : rep_(pack(other.data(), other.size())) { }
+    PackedString(PackedString&& other) noexcept : rep_(other.rep_) { other.rep_ = nullptr; }
+    PackedString& operator=(PackedString other) noexcept { std::swap(rep_, other.rep_); return *this; }
+    ~PackedString() { delete [] rep_; }
+
+    size_t size() const
+    {
+        uint32_t size = 0;
+        if(rep_) std::memcpy(&size, rep_, sizeof(size));
+        return size;
+    }
+    const char* data() const { return rep_ ? rep_ + sizeof(uint32_t) : ""; }
+    std::string str() const { return std::string(data(), size()); }
+
+    /**
+    * Three-way comparison of the bytes [data, data + size) against this
+    * string, both known to agree on their first lcp bytes. lcp is advanced
+    * to the length of their common prefix.
+    */
+    int compareFrom(const char* data, size_t size, size_t& lcp) const
+    {
+        const unsigned char* mine = reinterpret_cast<const unsigned char*>(this->data());
+        const unsigned char* theirs = reinterpret_cast<const unsigned char*>(data);
+        size_t mySize = this->size();
+        size_t common = std::min(size, mySize);
+        while(lcp < common && theirs[lcp] == mine[lcp]) {
+            ++lcp;
+        }
+        if(lcp < common) {
+            return theirs[lcp] < mine[lcp] ? -1 : 1;
+        }
+        return size < mySize ? -1 : (size > mySize ? 1 : 0);
+    }
+
+private:
+    static char* pack(const char* data, size_t size)
+    {
+        if(size > UINT32_MAX) throw std::length_error("PackedString too long");
+        uint32_t length = static_cast<uint32_t>(size);
+        char* rep = new char[sizeof(length) + size];
+        std::memcpy(rep, &length, sizeof(length));
+        std::memcpy(rep + sizeof(length), data, size);
+        return rep;
+    }
+
+    char* rep_;
+};
+
+inline bool operator<(const PackedString& a, const PackedString& b)
+{
+    size_t lcp = 0;
+    return b.compareFrom(a.data(), a.size(), lcp) < 0;
+}
+
+inline bool operator>(const PackedString& a, const PackedString& b)
+{
+    return b < a;
+}
+
+inline bool operator==(const PackedString& a, const PackedString& b)
+{
+    return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size()) == 0;
+}
+
+inline bool operator!=(const PackedString& a, const PackedString& b)
+{
+    return !(a == b);
+}
+
+inline std::ostream& operator<<(std::ostream& out, const PackedString& s)
+{
+    return out.write(s.data(), s.size());
+}
+
+/**
+* An AVLTree for string keys that share long prefixes (URLs, paths). Keys
+* are stored as PackedStrings, and lookups skip the prefix they are already
+* known to share with a node: every key in the subtree under descent lies
+* between the nearest smaller and larger keys passed on the way down, so
+* it agrees with the search key on the shorter of the search key's common
+* prefixes with those two. Each comparison starts there instead of at byte
+* zero, which often skips most of a long shared prefix. It only helps once
+* the descent has passed keys on both sides, though: while one bound's lcp
+* stays 0 (a search key below or above every key on its path, say) each
+* compare starts again at byte zero, so the worst case is still
+* O(L log n) byte compares for keys of length L.
+*
+* The std::string overloads below take that path; the inherited ones that
+* take a PackedString compare whole keys.
+*/
+template <class Value>
+class StringAVLTree : public AVLTree<PackedString, Value>
+{
+    typedef AVLTree<PackedString, Value> Base;
+    typedef AVLNode<PackedString, Value> StringNode;
+
+public:
+    typedef typename Base::iterator iterator;
+
+    using Base::insert;
+    virtual void insert(const std::pair<const PackedString, Value>& item);
+    void insert(const std::string& key, const Value& value);
+    using Base::remove;
+    void remove(const std::string& key);
+    using Base::find;
+    iterator find(const std::string& key) const;
+    bool contains(const std::string& key) const;
+    using Base::operator[];
+    Value& operator[](const std::string& key);
+    Value const & operator[](const std::string& key) const;
+
+protected:
+    StringNode* descend(const char* key, size_t size, StringNode*& parent, int& side) const;
+    void insertAt(StringNode* parent, int side, const PackedString& key, const Value& value);
+};
+
+/**
+* Finds key by lcp-skipping descent. On a miss returns NULL, with parent
+* the last node visited and side the sign of key against it, i.e. where a
+* new leaf for key belongs.
+*/
+template<class Value>
+typename StringAVLTree<Value>::StringNode* StringAVLTree<Value>::descend(
+    const char* key, size_t size, StringNode*& parent, int& side) const
+{
+  size_t lowLcp = 0;  // with the nearest smaller key passed, if any
+  size_t highLcp = 0; // with the nearest larger key passed, if any
+  parent = nullptr;
+  side = 0;
+  StringNode* node = static_cast<StringNode*>(this->root_);
+  while (node != nullptr) {
+    size_t lcp = std::min(lowLcp, highLcp);
+    int cmp = node->getKey().compareFrom(key, size, lcp);
+    if (cmp == 0) {
+      return node;
+    }
+    parent = node;
+    side = cmp;
+    if (cmp < 0) {
+      highLcp = lcp;
+      node = node->getLeft();
+    }
+    else {
+      lowLcp = lcp;
+      node = node->getRight();
+    }
+  }
+  return nullptr;
+}
+
+template<class Value>
+void StringAVLTree<Value>::insertAt(StringNode* parent, int side, const PackedString& key, const Value& value)
+{
+  StringNode* node = new StringNode(key, value, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+    return;
+  }
+  if (side < 0) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  this->insertFix(parent, node);
+}
+
+/**
+* As AVLTree::insert, with the lcp-skipping descent.
+*/
+template<class Value>
+void StringAVLTree<Value>::insert(const std::pair<const PackedString, Value>& item)
+{
+  StringNode* parent;
+  int side;
+  StringNode* node = descend(item.first.data(), item.first.size(), parent, side);
+  if (node != nullptr) {
+    node->setValue(item.second);
+    return;
+  }
+  insertAt(parent, side, item.first, item.second);
+}
+
+/**
+* Adds key, or overwrites its value. Only packs key when it is new.
+*/
+template<class Value>
+void StringAVLTree<Value>::insert(const std::string& key, const Value& value)
+{
+  StringNode* parent;
+  int side;
+  StringNode* node = descend(key.data(), key.size(), parent, side);
+  if (node != nullptr) {
+    node->setValue(value);
+    return;
+  }
+  insertAt(parent, side, PackedString(key), value);
+}
+
+template<class Value>
+void StringAVLTree<Value>::remove(const std::string& key)
+{
+  StringNode* parent;
+  int side;
+  StringNode* node = descend(key.data(), key.size(), parent, side);
+  if (node != nullptr) {
+    this->eraseNode(node);
+  }
+}
+
+template<class Value>
+typename StringAVLTree<Value>::iterator StringAVLTree<Value>::find(const std::string& key) const
+{
+  StringNode* parent;
+  int side;
+  return Base::iteratorAt(descend(key.data(), key.size(), parent, side));
+}
+
+template<class Value>
+bool StringAVLTree<Value>::contains(const std::string& key) const
+{
+  StringNode* parent;
+  int side;
+  return descend(key.data(), key.size(), parent, side) != nullptr;
+}
+
+template<class Value>
+Value& StringAVLTree<Value>::operator[](const std::string& key)
+{
+  StringNode* parent;
+  int side;
+  StringNode* node = descend(key.data(), key.size(), parent, side);
+  if (node == nullptr) throw std::out_of_range("Invalid key");
+  return node->getValue();
+}
+
+template<class Value>
+Value const & StringAVLTree<Value>::operator[](const std::string& key) const
+{
+  StringNode* parent;
+  int side;
+  StringNode* node = descend(key.data(), key.size(), parent, side);
+  if (node == nullptr) throw std::out_of_range("Invalid key");
+  return node->getValue();
+}
+
+#endif
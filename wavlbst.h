@@ -0,0 +1,350 @@
+#ifndef WAVLBST_H
+#define WAVLBST_H
+
+#include <cstdint>
+#include "bst.h"
+
+/**
+* A node for a weak AVL tree. It stores its rank in one byte, where
+* AVLNode stores its balance; a missing child has rank -1.
+*/
+template <typename Key, typename Value>
+class WAVLNode : public Node<Key, Value>
+{
+public:
+    WAVLNode(const Key& key, const Value& value, WAVLNode<Key, Value>* parent);
+    virtual ~WAVLNode();
+
+    int getRank() const;
+    void setRank(int rank);
+
+    virtual WAVLNode<Key, Value>* getParent() const override;
+    virtual WAVLNode<Key, Value>* getLeft() const override;
+    virtual WAVLNode<Key, Value>* getRight() const override;
+
+protected:
+    uint8_t rank_;      // at most 2 log2(n), so a byte is plenty
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the WAVLNode class.
+  -------------------------------------------------
+*/
+
+/**
+* New nodes are leaves, which have rank 0.
+*/
+template<class Key, class Value>
+WAVLNode<Key, Value>::WAVLNode(const Key& key, const Value& value, WAVLNode<Key, Value>* parent) :
+    Node<Key, Value>(key, value, parent), rank_(0)
+{
+
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>::~WAVLNode()
+{
+
+}
+
+template<class Key, class Value>
+int WAVLNode<Key, Value>::getRank() const
+{
+    return rank_;
+}
+
+template<class Key, class Value>
+void WAVLNode<Key, Value>::setRank(int rank)
+{
+    rank_ = static_cast<uint8_t>(rank);
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getParent() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->parent_);
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getLeft() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->left_);
+}
+
+template<class Key, class Value>
+WAVLNode<Key, Value>* WAVLNode<Key, Value>::getRight() const
+{
+    return static_cast<WAVLNode<Key, Value>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the WAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A weak AVL (rank-balanced) tree. Every node has a rank, every child's
+* rank is 1 or 2 below its parent's and leaves have rank 0. With inserts
+* only it builds exactly the trees AVLTree would, so lookups are as fast;
+* removes only relax the ranks, and rebalancing is O(1) amortized with at
+* most two rotations per update, where AVLTree may rotate all the way up
+* the path on a remove.
+*/
+template <class Key, class Value>
+class WAVLTree : public BinarySearchTree<Key, Value>
+{
+public:
+    WAVLTree();
+    WAVLTree(const WAVLTree<Key, Value>& other);
+    WAVLTree(WAVLTree<Key, Value>&& other) noexcept;
+    WAVLTree<Key, Value>& operator=(const WAVLTree<Key, Value>& other);
+    WAVLTree<Key, Value>& operator=(WAVLTree<Key, Value>&& other) noexcept;
+
+    typedef NodeHandle<Key, Value, WAVLTree<Key, Value> > node_type;
+    node_type extract(const Key& key);
+    node_type extract(typename BinarySearchTree<Key, Value>::iterator pos);
+    typename BinarySearchTree<Key, Value>::iterator insert(node_type&& handle);
+    virtual void insert(const std::pair<const Key, Value>& new_item);
+
+protected:
+    virtual void detachNode(Node<Key, Value>* node);
+    virtual Node<Key, Value>* attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+        typename BinarySearchTree<Key, Value>::NodeDispose dispose);
+    static int rank(WAVLNode<Key, Value>* node);
+    void insertFix(WAVLNode<Key, Value>* node);
+    void removeFix(WAVLNode<Key, Value>* parent, WAVLNode<Key, Value>* node);
+};
+
+template<class Key, class Value>
+WAVLTree<Key, Value>::WAVLTree()
+{
+}
+
+/**
+* Copies other node for node, ranks included, in O(n).
+*/
+template<class Key, class Value>
+WAVLTree<Key, Value>::WAVLTree(const WAVLTree<Key, Value>& other) : BinarySearchTree<Key, Value>()
+{
+  this->template cloneFrom<WAVLNode<Key, Value> >(other);
+}
+
+template<class Key, class Value>
+WAVLTree<Key, Value>::WAVLTree(WAVLTree<Key, Value>&& other) noexcept : BinarySearchTree<Key, Value>(std::move(other))
+{
+}
+
+template<class Key, class Value>
+WAVLTree<Key, Value>& WAVLTree<Key, Value>::operator=(const WAVLTree<Key, Value>& other)
+{
+  if (this != &other) {
+    this->clear();
+    this->template cloneFrom<WAVLNode<Key, Value> >(other);
+  }
+  return *this;
+}
+
+template<class Key, class Value>
+WAVLTree<Key, Value>& WAVLTree<Key, Value>::operator=(WAVLTree<Key, Value>&& other) noexcept
+{
+  BinarySearchTree<Key, Value>::operator=(std::move(other));
+  return *this;
+}
+
+template<class Key, class Value>
+int WAVLTree<Key, Value>::rank(WAVLNode<Key, Value>* node)
+{
+  return node == nullptr ? -1 : node->getRank();
+}
+
+template<class Key, class Value>
+void WAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& new_item)
+{
+  WAVLNode<Key, Value>* parent = nullptr;
+  WAVLNode<Key, Value>* node = static_cast<WAVLNode<Key, Value>*>(this->root_);
+  while (node != nullptr) {
+    if (new_item.first < node->getKey()) {
+      parent = node;
+      node = node->getLeft();
+    }
+    else if (node->getKey() < new_item.first) {
+      parent = node;
+      node = node->getRight();
+    }
+    else {
+      node->setValue(new_item.second);
+      return;
+    }
+  }
+
+  node = new WAVLNode<Key, Value>(new_item.first, new_item.second, parent);
+  if (parent == nullptr) {
+    this->root_ = node;
+    return;
+  }
+  if (new_item.first < parent->getKey()) {
+    parent->setLeft(node);
+  }
+  else {
+    parent->setRight(node);
+  }
+  this->linkInOrder(node);
+  insertFix(node);
+}
+
+/**
+* As BinarySearchTree's, but with handles only a WAVLTree takes back.
+*/
+template<class Key, class Value>
+typename WAVLTree<Key, Value>::node_type WAVLTree<Key, Value>::extract(const Key& key)
+{
+  return this->template extractKey<node_type>(key);
+}
+
+template<class Key, class Value>
+typename WAVLTree<Key, Value>::node_type WAVLTree<Key, Value>::extract(typename BinarySearchTree<Key, Value>::iterator pos)
+{
+  return this->template extractAt<node_type>(pos);
+}
+
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator WAVLTree<Key, Value>::insert(node_type&& handle)
+{
+  return this->insertHandle(std::move(handle));
+}
+
+/**
+* Links a node extracted from another WAVLTree as a fresh rank-0 leaf.
+*/
+template<class Key, class Value>
+Node<Key, Value>* WAVLTree<Key, Value>::attachNode(Node<Key, Value>* node, const std::shared_ptr<void>& storage,
+    typename BinarySearchTree<Key, Value>::NodeDispose dispose)
+{
+  (void)storage;
+  (void)dispose;
+  Node<Key, Value>* at = this->placeLeaf(node);
+  if (at == node) {
+    WAVLNode<Key, Value>* leaf = static_cast<WAVLNode<Key, Value>*>(node);
+    leaf->setRank(0);
+    insertFix(leaf);
+  }
+  return at;
+}
+
+/**
+* node has the same rank as its parent. Promotes the parent while its
+* other child is a 1-child, otherwise ends with one or two rotations.
+*/
+template<class Key, class Value>
+void WAVLTree<Key, Value>::insertFix(WAVLNode<Key, Value>* node)
+{
+  WAVLNode<Key, Value>* parent = node->getParent();
+  while (parent != nullptr && parent->getRank() == node->getRank()) {
+    bool nodeLeft = (node == parent->getLeft());
+    WAVLNode<Key, Value>* sibling = nodeLeft ? parent->getRight() : parent->getLeft();
+    if (parent->getRank() - rank(sibling) == 1) {
+      parent->setRank(parent->getRank() + 1);
+      node = parent;
+      parent = node->getParent();
+      continue;
+    }
+
+    WAVLNode<Key, Value>* inner = nodeLeft ? node->getRight() : node->getLeft();
+    if (node->getRank() - rank(inner) == 2) {
+      nodeLeft ? this->rotateRight(parent) : this->rotateLeft(parent);
+      parent->setRank(parent->getRank() - 1);
+    }
+    else {
+      nodeLeft ? this->rotateLeft(node) : this->rotateRight(node);
+      nodeLeft ? this->rotateRight(parent) : this->rotateLeft(parent);
+      inner->setRank(inner->getRank() + 1);
+      node->setRank(node->getRank() - 1);
+      parent->setRank(parent->getRank() - 1);
+    }
+    return;
+  }
+}
+
+/**
+* Splices node out with BinarySearchTree::spliceOut(); a predecessor moved
+* into its place takes its rank. Ranks are then repaired from the spot
+* that lost a node.
+*/
+template<class Key, class Value>
+void WAVLTree<Key, Value>::detachNode(Node<Key, Value>* victim)
+{
+  WAVLNode<Key, Value>* node = static_cast<WAVLNode<Key, Value>*>(victim);
+  this->unlinkInOrder(node);
+
+  WAVLNode<Key, Value>* heir = nullptr;
+  if (node->getLeft() != nullptr && node->getRight() != nullptr) {
+    heir = static_cast<WAVLNode<Key, Value>*>(this->predecessor(node));
+  }
+  bool leftShrank;
+  WAVLNode<Key, Value>* parent = static_cast<WAVLNode<Key, Value>*>(this->spliceOut(node, leftShrank));
+  if (heir != nullptr) {
+    heir->setRank(node->getRank());
+  }
+  if (parent != nullptr) {
+    removeFix(parent, leftShrank ? parent->getLeft() : parent->getRight());
+  }
+}
+
+/**
+* node (possibly missing) has just replaced a removed child of parent.
+* A leaf left with two 2-children is demoted; then, while node is a
+* 3-child, parent is demoted (together with the sibling if both the
+* sibling's children are 2-children) or one rotation or double rotation
+* at the sibling ends the repair.
+*/
+template<class Key, class Value>
+void WAVLTree<Key, Value>::removeFix(WAVLNode<Key, Value>* parent, WAVLNode<Key, Value>* node)
+{
+  if (parent->getLeft() == nullptr && parent->getRight() == nullptr && parent->getRank() == 1) {
+    parent->setRank(0);
+    node = parent;
+    parent = node->getParent();
+  }
+
+  while (parent != nullptr && parent->getRank() - rank(node) == 3) {
+    bool nodeLeft = (node == parent->getLeft());
+    WAVLNode<Key, Value>* sibling = nodeLeft ? parent->getRight() : parent->getLeft();
+    if (parent->getRank() - sibling->getRank() == 2) {
+      parent->setRank(parent->getRank() - 1);
+      node = parent;
+      parent = node->getParent();
+      continue;
+    }
+
+    WAVLNode<Key, Value>* inner = nodeLeft ? sibling->getLeft() : sibling->getRight();
+    WAVLNode<Key, Value>* outer = nodeLeft ? sibling->getRight() : sibling->getLeft();
+    if (sibling->getRank() - rank(inner) == 2 && sibling->getRank() - rank(outer) == 2) {
+      parent->setRank(parent->getRank() - 1);
+      sibling->setRank(sibling->getRank() - 1);
+      node = parent;
+      parent = node->getParent();
+      continue;
+    }
+
+    if (sibling->getRank() - rank(outer) == 1) {
+      nodeLeft ? this->rotateLeft(parent) : this->rotateRight(parent);
+      sibling->setRank(sibling->getRank() + 1);
+      parent->setRank(parent->getRank() - 1);
+      if (parent->getLeft() == nullptr && parent->getRight() == nullptr) {
+        parent->setRank(parent->getRank() - 1);
+      }
+    }
+    else {
+      nodeLeft ? this->rotateRight(sibling) : this->rotateLeft(sibling);
+      nodeLeft ? this->rotateLeft(parent) : this->rotateRight(parent);
+      inner->setRank(inner->getRank() + 2);
+      sibling->setRank(sibling->getRank() - 1);
+      parent->setRank(parent->getRank() - 2);
+    }
+    return;
+  }
+}
+
+#endif